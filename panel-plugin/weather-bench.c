@@ -0,0 +1,653 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Benchmark of the data pipeline, run by make check. It loads the
+ * met.no locationforecast and sunrise fixtures in tests/data, moves
+ * them to the current time, as the pipeline drops data of the past,
+ * and times every stage from parsing to building the forecast grid.
+ * Results are reported in ns/op and allocations per op. With glibc,
+ * all allocations of the process are counted, including those of
+ * GLib and libxml2, otherwise only timeslice allocations.
+ * The benchmark fails if a fixture cannot be used, so that broken
+ * data handling is caught along with slow one.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "weather-parsers.h"
+#include "weather-data.h"
+#include "weather-debug.h"
+
+/* minimal time spent measuring each stage, in microseconds */
+#define BENCH_MIN_TIME (G_USEC_PER_SEC / 4)
+
+/* interval of current conditions updates in the plugin */
+#define CONDITIONS_STEP (5 * 60)
+
+
+gboolean debug_mode = FALSE;
+
+#ifdef __GLIBC__
+/*
+ * Count the allocations of the whole process by putting wrappers in
+ * front of the allocator of the C library, which the shared libraries
+ * will use as well.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb,
+                           size_t size);
+extern void *__libc_realloc(void *ptr,
+                            size_t size);
+
+static gboolean count_allocs = FALSE;
+static guint64 allocs_counted = 0;
+
+void *
+malloc(size_t size)
+{
+    if (count_allocs)
+        allocs_counted++;
+    return __libc_malloc(size);
+}
+
+
+void *
+calloc(size_t nmemb,
+       size_t size)
+{
+    if (count_allocs)
+        allocs_counted++;
+    return __libc_calloc(nmemb, size);
+}
+
+
+void *
+realloc(void *ptr,
+        size_t size)
+{
+    if (count_allocs)
+        allocs_counted++;
+    return __libc_realloc(ptr, size);
+}
+
+#define ALLOCS_COLUMN "allocs/op"
+
+static void
+allocs_begin(void)
+{
+    allocs_counted = 0;
+    count_allocs = TRUE;
+}
+
+
+static guint64
+allocs_end(void)
+{
+    count_allocs = FALSE;
+    return allocs_counted;
+}
+
+#else
+
+/* only timeslice allocations can be counted, see weather-debug.c */
+#define ALLOCS_COLUMN "timeslices/op"
+
+static guint64 allocs_start;
+
+static void
+allocs_begin(void)
+{
+    debug_mode = TRUE;
+    allocs_start = weather_profile_get_allocs();
+}
+
+
+static guint64
+allocs_end(void)
+{
+    debug_mode = FALSE;
+    return weather_profile_get_allocs() - allocs_start;
+}
+#endif
+
+
+typedef struct {
+    const gchar *forecast;
+    const gchar *astro;
+    guint days;
+
+    /* filled in by load_fixture */
+    gchar *weather_data;
+    gsize weather_len;
+    gchar *astro_data;
+    gsize astro_len;
+    xml_weather *wd;            /* parsed data, shared by the stages */
+    time_t start_t;
+} bench_fixture;
+
+typedef struct {
+    const gchar *name;
+    gpointer (*setup) (bench_fixture *fx);
+    guint (*run) (gpointer state,
+                  bench_fixture *fx);     /* returns the ops done */
+    void (*teardown) (gpointer state);
+} bench_stage;
+
+static bench_fixture fixtures[] = {
+    { "locationforecast-1d-6h.xml", "sunrise-1d.xml", 1 },
+    { "locationforecast-1d-1h.xml", "sunrise-1d.xml", 1 },
+    { "locationforecast-3d-6h.xml", "sunrise-3d.xml", 3 },
+    { "locationforecast-3d-1h.xml", "sunrise-3d.xml", 3 },
+    { "locationforecast-10d-6h.xml", "sunrise-10d.xml", 10 },
+    { "locationforecast-10d-1h.xml", "sunrise-10d.xml", 10 }
+};
+
+static gint64 offset_s;
+
+
+/*
+ * Move a date (and time) matched in a fixture by offset_s, or by the
+ * whole days of it if there is only a date.
+ */
+static gboolean
+shift_date(const GMatchInfo *info,
+           GString *result,
+           gpointer user_data)
+{
+    GDateTime *dt, *shifted;
+    gchar *str, *formatted;
+    gint values[6] = { 0 };
+    gboolean has_time;
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(values); i++) {
+        str = g_match_info_fetch(info, i + 1);
+        if (str && *str)
+            values[i] = atoi(str);
+        g_free(str);
+    }
+    str = g_match_info_fetch(info, 4);
+    has_time = (str && *str);
+    g_free(str);
+
+    dt = g_date_time_new_utc(values[0], values[1], values[2],
+                             values[3], values[4], values[5]);
+    if (has_time) {
+        shifted = g_date_time_add_seconds(dt, offset_s);
+        formatted = g_date_time_format(shifted, "%Y-%m-%dT%H:%M:%S");
+    } else {
+        shifted = g_date_time_add_days(dt, offset_s / (24 * 3600));
+        formatted = g_date_time_format(shifted, "%Y-%m-%d");
+    }
+    g_string_append(result, formatted);
+    g_free(formatted);
+    g_date_time_unref(shifted);
+    g_date_time_unref(dt);
+    return FALSE;
+}
+
+
+static gchar *
+load_data(const gchar *dir,
+          const gchar *name,
+          gsize *len)
+{
+    GError *error = NULL;
+    gchar *file, *contents = NULL;
+
+    file = g_build_filename(dir, name, NULL);
+    if (!g_file_get_contents(file, &contents, len, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+    }
+    g_free(file);
+    return contents;
+}
+
+
+static gchar *
+shift_dates(GRegex *dates,
+            const gchar *contents,
+            gsize *len)
+{
+    gchar *shifted;
+
+    shifted = g_regex_replace_eval(dates, contents, *len, 0, 0,
+                                   shift_date, NULL, NULL);
+    *len = strlen(shifted);
+    return shifted;
+}
+
+
+/*
+ * Read the files of a fixture. The forecast is moved to start at the
+ * current hour, the astronomical data by the same number of days.
+ */
+static gboolean
+load_fixture(const gchar *dir,
+             bench_fixture *fx)
+{
+    GRegex *dates;
+    time_t now_t, fixture_t;
+    gchar *first, *contents;
+
+    fx->weather_data = load_data(dir, fx->forecast, &fx->weather_len);
+    fx->astro_data = load_data(dir, fx->astro, &fx->astro_len);
+    if (fx->weather_data == NULL || fx->astro_data == NULL)
+        return FALSE;
+
+    first = strstr(fx->weather_data, "from=\"");
+    fixture_t = first ? parse_timestring(first + 6, NULL, FALSE) : 0;
+    if (G_UNLIKELY(fixture_t == 0)) {
+        g_printerr("No forecast data in %s.\n", fx->forecast);
+        return FALSE;
+    }
+    now_t = time(NULL);
+    fx->start_t = now_t - now_t % 3600;
+    offset_s = (gint64) fx->start_t - fixture_t;
+
+    dates = g_regex_new("(\\d{4})-(\\d{2})-(\\d{2})"
+                        "(?:T(\\d{2}):(\\d{2}):(\\d{2}))?",
+                        G_REGEX_OPTIMIZE, 0, NULL);
+    contents = fx->astro_data;
+    fx->astro_data = shift_dates(dates, contents, &fx->astro_len);
+    g_free(contents);
+
+    contents = fx->weather_data;
+    fx->weather_data = shift_dates(dates, contents, &fx->weather_len);
+    g_free(contents);
+    g_regex_unref(dates);
+
+    fx->wd = make_weather_data();
+    if (!parse_weather_buffer(fx->weather_data, fx->weather_len, fx->wd) ||
+        fx->wd->timeslices->len == 0) {
+        g_printerr("Could not parse %s.\n", fx->forecast);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+static void
+free_fixture(bench_fixture *fx)
+{
+    g_free(fx->weather_data);
+    g_free(fx->astro_data);
+    if (fx->wd)
+        xml_weather_free(fx->wd);
+}
+
+
+/* parse_weather_buffer */
+
+static gpointer
+parse_setup(bench_fixture *fx)
+{
+    return make_weather_data();
+}
+
+
+static guint
+parse_run(gpointer state,
+          bench_fixture *fx)
+{
+    return parse_weather_buffer(fx->weather_data, fx->weather_len, state);
+}
+
+
+/* merge_timeslice, as when reading the cache file */
+
+static gpointer
+merge_setup(bench_fixture *fx)
+{
+    return make_weather_data();
+}
+
+
+static guint
+merge_run(gpointer state,
+          bench_fixture *fx)
+{
+    guint i;
+
+    for (i = 0; i < fx->wd->timeslices->len; i++)
+        merge_timeslice(state,
+                        g_array_index(fx->wd->timeslices, xml_time *, i));
+    return fx->wd->timeslices->len;
+}
+
+
+/* get_timeslice, for every timeslice */
+
+static gpointer
+lookup_setup(bench_fixture *fx)
+{
+    return fx->wd;
+}
+
+
+static guint
+lookup_run(gpointer state,
+           bench_fixture *fx)
+{
+    xml_weather *wd = state;
+    xml_time *timeslice;
+    guint i, found = 0;
+
+    for (i = 0; i < wd->timeslices->len; i++) {
+        timeslice = g_array_index(wd->timeslices, xml_time *, i);
+        if (get_timeslice(wd, timeslice->start, timeslice->end))
+            found++;
+    }
+    return found;
+}
+
+
+/*
+ * The linear search get_timeslice used before the index, to show
+ * what the index saves.
+ */
+static xml_time *
+find_timeslice_linear(xml_weather *wd,
+                      const time_t start_t,
+                      const time_t end_t)
+{
+    xml_time *timeslice;
+    guint i;
+
+    for (i = 0; i < wd->timeslices->len; i++) {
+        timeslice = g_array_index(wd->timeslices, xml_time *, i);
+        if (timeslice->start == start_t && timeslice->end == end_t)
+            return timeslice;
+    }
+    return NULL;
+}
+
+
+static guint
+lookup_linear_run(gpointer state,
+                  bench_fixture *fx)
+{
+    xml_weather *wd = state;
+    xml_time *timeslice;
+    guint i, found = 0;
+
+    for (i = 0; i < wd->timeslices->len; i++) {
+        timeslice = g_array_index(wd->timeslices, xml_time *, i);
+        if (find_timeslice_linear(wd, timeslice->start, timeslice->end))
+            found++;
+    }
+    return found;
+}
+
+
+/*
+ * xml_weather_clean, removing the expired half of the data. Merging
+ * drops expired timeslices, so they are moved into the past and added
+ * directly.
+ */
+
+static gpointer
+clean_setup(bench_fixture *fx)
+{
+    xml_weather *wd;
+    xml_time *timeslice;
+    time_t shift;
+    guint i;
+
+    shift = DATA_EXPIRY_TIME + (time_t) fx->days * 24 * 3600 / 2;
+    wd = make_weather_data();
+    for (i = 0; i < fx->wd->timeslices->len; i++) {
+        timeslice = xml_time_copy(g_array_index(fx->wd->timeslices,
+                                                xml_time *, i));
+        timeslice->start -= shift;
+        timeslice->end -= shift;
+        xml_weather_add_timeslice(wd, timeslice);
+    }
+    return wd;
+}
+
+
+static guint
+clean_run(gpointer state,
+          bench_fixture *fx)
+{
+    xml_weather *wd = state;
+    guint len = wd->timeslices->len;
+
+    xml_weather_clean(wd);
+    return wd->timeslices->len < len ? 1 : 0;
+}
+
+
+static void
+weather_teardown(gpointer state)
+{
+    xml_weather_free(state);
+}
+
+
+/* make_current_conditions, every 5 minutes for a day */
+
+static gpointer
+conditions_setup(bench_fixture *fx)
+{
+    xml_weather_invalidate(fx->wd);
+    return fx->wd;
+}
+
+
+static guint
+conditions_run(gpointer state,
+               bench_fixture *fx)
+{
+    xml_time *conditions;
+    guint i, found = 0;
+
+    for (i = 0; i < 24 * 3600 / CONDITIONS_STEP; i++) {
+        conditions = make_current_conditions(state, fx->start_t +
+                                             i * CONDITIONS_STEP);
+        if (conditions) {
+            xml_time_free(conditions);
+            found++;
+        }
+    }
+    return found;
+}
+
+
+/* make_forecast_grid */
+
+static gpointer
+forecast_setup(bench_fixture *fx)
+{
+    xml_weather_invalidate(fx->wd);
+    return fx->wd;
+}
+
+
+static guint
+forecast_run(gpointer state,
+             bench_fixture *fx)
+{
+    forecast_grid *grid;
+    guint day, cells = 0;
+    daytime dt;
+
+    grid = make_forecast_grid(state, fx->days);
+    for (day = 0; day < grid->days; day++)
+        for (dt = MORNING; dt <= NIGHT; dt++)
+            if (forecast_grid_get(grid, day, dt))
+                cells++;
+    forecast_grid_free(grid);
+    return cells ? 1 : 0;
+}
+
+
+/* parse_astrodata and astrodata_clean */
+
+static gpointer
+astro_setup(bench_fixture *fx)
+{
+    return g_array_sized_new(FALSE, TRUE, sizeof(xml_astro *), 30);
+}
+
+
+static guint
+astro_run(gpointer state,
+          bench_fixture *fx)
+{
+    xmlDoc *doc;
+    xmlNode *root_node, *child_node;
+    gboolean result = FALSE;
+
+    doc = xmlReadMemory(fx->astro_data, fx->astro_len, NULL, "UTF-8", 0);
+    if (G_UNLIKELY(doc == NULL))
+        return 0;
+    root_node = xmlDocGetRootElement(doc);
+    if (G_LIKELY(root_node))
+        for (child_node = root_node->children; child_node;
+             child_node = child_node->next)
+            if (child_node->type == XML_ELEMENT_NODE &&
+                parse_astrodata(child_node, state))
+                result = TRUE;
+    xmlFreeDoc(doc);
+    astrodata_clean(state);
+    return result && ((GArray *) state)->len > 0;
+}
+
+
+static void
+astro_teardown(gpointer state)
+{
+    astrodata_free(state);
+}
+
+
+static const bench_stage stages[] = {
+    { "parse", parse_setup, parse_run, weather_teardown },
+    { "merge timeslice", merge_setup, merge_run, weather_teardown },
+    { "lookup timeslice", lookup_setup, lookup_run, NULL },
+    { "lookup (linear)", lookup_setup, lookup_linear_run, NULL },
+    { "clean weather data", clean_setup, clean_run, weather_teardown },
+    { "current conditions", conditions_setup, conditions_run, NULL },
+    { "forecast grid", forecast_setup, forecast_run, NULL },
+    { "parse astrodata", astro_setup, astro_run, astro_teardown }
+};
+
+
+/*
+ * Run a stage until BENCH_MIN_TIME has passed, then once more with
+ * allocation counting, so that counting does not affect the timing.
+ * Returns FALSE if the stage did not do anything.
+ */
+static gboolean
+measure(const bench_stage *stage,
+        bench_fixture *fx)
+{
+    gpointer state;
+    gint64 begin, elapsed = 0;
+    guint64 ops = 0, allocs;
+    guint done;
+
+    do {
+        state = stage->setup(fx);
+        begin = g_get_monotonic_time();
+        done = stage->run(state, fx);
+        elapsed += g_get_monotonic_time() - begin;
+        if (stage->teardown)
+            stage->teardown(state);
+        if (done == 0)
+            break;
+        ops += done;
+    } while (elapsed < BENCH_MIN_TIME);
+
+    if (ops == 0) {
+        printf("  %-20s failed\n", stage->name);
+        return FALSE;
+    }
+
+    state = stage->setup(fx);
+    allocs_begin();
+    done = stage->run(state, fx);
+    allocs = allocs_end();
+    if (stage->teardown)
+        stage->teardown(state);
+
+    printf("  %-20s %10" G_GUINT64_FORMAT " %12.0f %12.1f\n",
+           stage->name, ops, elapsed * 1000.0 / ops,
+           done ? (gdouble) allocs / done : 0.0);
+    return TRUE;
+}
+
+
+int
+main(int argc,
+     char **argv)
+{
+    const gchar *srcdir;
+    gchar *dir;
+    guint i, j;
+    gint status = 0;
+
+#ifdef __GLIBC__
+    /* let the slice allocator of older GLib versions use malloc, so
+       that its allocations are counted too */
+    g_setenv("G_SLICE", "always-malloc", TRUE);
+#endif
+
+    /* make check passes srcdir, so that the fixtures are found in
+       out-of-tree builds */
+    if (argc > 1)
+        dir = g_strdup(argv[1]);
+    else {
+        srcdir = g_getenv("srcdir");
+        dir = g_build_filename(srcdir ? srcdir : ".", "tests", "data", NULL);
+    }
+
+    for (i = 0; i < G_N_ELEMENTS(fixtures); i++) {
+        if (!load_fixture(dir, &fixtures[i])) {
+            printf("%s: could not be loaded\n", fixtures[i].forecast);
+            free_fixture(&fixtures[i]);
+            status = 1;
+            continue;
+        }
+
+        printf("%s (%u timeslices, %" G_GSIZE_FORMAT " bytes):\n",
+               fixtures[i].forecast, fixtures[i].wd->timeslices->len,
+               fixtures[i].weather_len);
+        printf("  %-20s %10s %12s %12s\n",
+               "stage", "ops", "ns/op", ALLOCS_COLUMN);
+        for (j = 0; j < G_N_ELEMENTS(stages); j++)
+            if (!measure(&stages[j], &fixtures[i]))
+                status = 1;
+        printf("\n");
+        free_fixture(&fixtures[i]);
+    }
+
+    g_free(dir);
+    xmlCleanupParser();
+    return status;
+}
@@ -0,0 +1,704 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The cache file is a header followed by the astrodata records, the
+ * timeslice records and a block of NUL-terminated strings, which are
+ * referenced by their offset in that block. It is written in host
+ * byte order, as it is only meant to be read on the same machine,
+ * and is used directly from a read-only memory mapping.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+#include <libxfce4util/libxfce4util.h>
+
+#include "weather-cache.h"
+#include "weather-parsers.h"
+#include "weather-data.h"
+#include "weather-debug.h"
+
+#define CACHE_MAGIC "XFWEATHR"
+#define CACHE_MAGIC_LEN 8
+#define CACHE_VERSION 3
+#define CACHE_BYTE_ORDER 0x01020304
+#define CACHE_NO_STRING G_MAXUINT32
+
+#define CACHE_SUN_NEVER_RISES  (1 << 0)
+#define CACHE_SUN_NEVER_SETS   (1 << 1)
+#define CACHE_MOON_NEVER_RISES (1 << 2)
+#define CACHE_MOON_NEVER_SETS  (1 << 3)
+
+#define CACHE_STRING(strings, offset)                   \
+    ((offset) == CACHE_NO_STRING ? NULL : (strings) + (offset))
+
+#define CACHE_INTERNED(strings, offset)                 \
+    ((offset) == CACHE_NO_STRING                        \
+     ? NULL : g_intern_string((strings) + (offset)))
+
+
+typedef struct {
+    gchar magic[CACHE_MAGIC_LEN];
+    guint32 version;
+    guint32 byte_order;
+    guint32 num_values;
+    guint32 num_astro;
+    guint32 num_timeslices;
+    guint32 strings_len;
+    gint64 cache_date;
+    gint64 last_weather_download;
+    gint64 last_astro_download;
+    gint64 weather_expires;
+    gint64 weather_last_modified;
+    gint64 astro_expires;
+    gint64 astro_last_modified;
+    gint32 msl;
+    guint32 location_name;
+    guint32 lat;
+    guint32 lon;
+    guint32 offset;
+    guint32 weather_url;
+    guint32 astro_url;
+    guint32 padding;
+} cache_header;
+
+typedef struct {
+    gint64 day;
+    gint64 sunrise;
+    gint64 sunset;
+    gint64 moonrise;
+    gint64 moonset;
+    gdouble solarnoon_elevation;
+    gdouble solarmidnight_elevation;
+    guint32 flags;
+    guint32 moon_phase;
+} cache_astro;
+
+typedef struct {
+    gint64 start;
+    gint64 end;
+    gint64 point;
+    gdouble values[LOC_VALUES_NUM];
+    guint32 valid;
+    gint32 symbol_id;
+    guint32 temperature_unit;
+    guint32 wind_dir_name;
+    guint32 humidity_unit;
+    guint32 pressure_unit;
+    guint32 precipitation_unit;
+    guint32 symbol;
+} cache_timeslice;
+
+/* all records need to stay 8-byte aligned in the mapped file */
+G_STATIC_ASSERT(sizeof(cache_header) % 8 == 0);
+G_STATIC_ASSERT(sizeof(cache_astro) % 8 == 0);
+G_STATIC_ASSERT(sizeof(cache_timeslice) % 8 == 0);
+
+/*
+ * Writes cache files in a worker thread. Only the most recent
+ * contents of each file are kept, so that a write that has not been
+ * started yet is replaced when newer contents for the same file
+ * arrive.
+ */
+struct _weather_cache_writer {
+    GThreadPool *pool;
+    GMutex lock;
+    GHashTable *pending;  /* file -> cache_write, protected by lock */
+};
+
+/* write of a cache file that has not been started yet */
+typedef struct {
+    GBytes *contents;
+    gint lock_fd;         /* download lock released after the write */
+} cache_write;
+
+/* string block of a cache file being written */
+typedef struct {
+    GString *data;
+    GHashTable *offsets;
+} cache_strings;
+
+
+/*
+ * Add a string to the string block, storing each distinct string
+ * only once, and return its offset.
+ */
+static guint32
+cache_add_string(cache_strings *strings,
+                 const gchar *str)
+{
+    gpointer offset;
+
+    if (str == NULL)
+        return CACHE_NO_STRING;
+
+    if (g_hash_table_lookup_extended(strings->offsets, str, NULL, &offset))
+        return GPOINTER_TO_UINT(offset);
+
+    offset = GUINT_TO_POINTER(strings->data->len);
+    g_string_append_len(strings->data, str, strlen(str) + 1);
+    g_hash_table_insert(strings->offsets, (gpointer) str, offset);
+    return GPOINTER_TO_UINT(offset);
+}
+
+
+/*
+ * Serialize the weather data into the contents of a cache file.
+ */
+GBytes *
+weather_cache_serialize(const weather_cache_info *info,
+                        const GArray *astrodata,
+                        const xml_weather *wd)
+{
+    cache_header header;
+    cache_astro ca;
+    cache_timeslice ct;
+    cache_strings strings;
+    GByteArray *astros, *timeslices, *out;
+    const xml_astro *astro;
+    const xml_time *timeslice;
+    const xml_location *loc;
+    guint i;
+
+    g_assert(info != NULL && wd != NULL);
+    if (G_UNLIKELY(info == NULL || wd == NULL))
+        return NULL;
+
+    strings.data = g_string_sized_new(1024);
+    strings.offsets = g_hash_table_new(g_str_hash, g_str_equal);
+
+    astros = g_byte_array_new();
+    for (i = 0; astrodata && i < astrodata->len; i++) {
+        astro = g_array_index(astrodata, xml_astro *, i);
+        if (G_UNLIKELY(astro == NULL))
+            continue;
+        memset(&ca, 0, sizeof(ca));
+        ca.day = astro->day;
+        ca.sunrise = astro->sunrise;
+        ca.sunset = astro->sunset;
+        ca.moonrise = astro->moonrise;
+        ca.moonset = astro->moonset;
+        ca.solarnoon_elevation = astro->solarnoon_elevation;
+        ca.solarmidnight_elevation = astro->solarmidnight_elevation;
+        if (astro->sun_never_rises)
+            ca.flags |= CACHE_SUN_NEVER_RISES;
+        if (astro->sun_never_sets)
+            ca.flags |= CACHE_SUN_NEVER_SETS;
+        if (astro->moon_never_rises)
+            ca.flags |= CACHE_MOON_NEVER_RISES;
+        if (astro->moon_never_sets)
+            ca.flags |= CACHE_MOON_NEVER_SETS;
+        ca.moon_phase = cache_add_string(&strings, astro->moon_phase);
+        g_byte_array_append(astros, (const guint8 *) &ca, sizeof(ca));
+    }
+
+    timeslices = g_byte_array_sized_new(wd->timeslices->len * sizeof(ct));
+    for (i = 0; i < wd->timeslices->len; i++) {
+        timeslice = g_array_index(wd->timeslices, xml_time *, i);
+        if (G_UNLIKELY(timeslice == NULL || timeslice->location == NULL))
+            continue;
+        loc = timeslice->location;
+        memset(&ct, 0, sizeof(ct));
+        ct.start = timeslice->start;
+        ct.end = timeslice->end;
+        ct.point = timeslice->point;
+        memcpy(ct.values, loc->values, sizeof(ct.values));
+        ct.valid = loc->valid;
+        ct.symbol_id = loc->symbol_id;
+        ct.temperature_unit = cache_add_string(&strings, loc->temperature_unit);
+        ct.wind_dir_name = cache_add_string(&strings, loc->wind_dir_name);
+        ct.humidity_unit = cache_add_string(&strings, loc->humidity_unit);
+        ct.pressure_unit = cache_add_string(&strings, loc->pressure_unit);
+        ct.precipitation_unit =
+            cache_add_string(&strings, loc->precipitation_unit);
+        ct.symbol = cache_add_string(&strings, loc->symbol);
+        g_byte_array_append(timeslices, (const guint8 *) &ct, sizeof(ct));
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, CACHE_MAGIC_LEN);
+    header.version = CACHE_VERSION;
+    header.byte_order = CACHE_BYTE_ORDER;
+    header.num_values = LOC_VALUES_NUM;
+    header.num_astro = astros->len / sizeof(cache_astro);
+    header.num_timeslices = timeslices->len / sizeof(cache_timeslice);
+    header.cache_date = info->cache_date;
+    header.last_weather_download = info->last_weather_download;
+    header.last_astro_download = info->last_astro_download;
+    header.weather_expires = info->weather_expires;
+    header.weather_last_modified = info->weather_last_modified;
+    header.astro_expires = info->astro_expires;
+    header.astro_last_modified = info->astro_last_modified;
+    header.msl = info->msl;
+    header.location_name = cache_add_string(&strings, info->location_name);
+    header.lat = cache_add_string(&strings, info->lat);
+    header.lon = cache_add_string(&strings, info->lon);
+    header.offset = cache_add_string(&strings, info->offset);
+    header.weather_url = cache_add_string(&strings, info->weather_url);
+    header.astro_url = cache_add_string(&strings, info->astro_url);
+    header.strings_len = strings.data->len;
+
+    out = g_byte_array_sized_new(sizeof(header) + astros->len
+                                 + timeslices->len + strings.data->len);
+    g_byte_array_append(out, (const guint8 *) &header, sizeof(header));
+    g_byte_array_append(out, astros->data, astros->len);
+    g_byte_array_append(out, timeslices->data, timeslices->len);
+    g_byte_array_append(out, (const guint8 *) strings.data->str,
+                        strings.data->len);
+
+    g_byte_array_free(astros, TRUE);
+    g_byte_array_free(timeslices, TRUE);
+    g_hash_table_destroy(strings.offsets);
+    g_string_free(strings.data, TRUE);
+    return g_byte_array_free_to_bytes(out);
+}
+
+
+static gboolean
+cache_string_is_valid(const cache_header *header,
+                      const guint32 offset)
+{
+    return (offset == CACHE_NO_STRING || offset < header->strings_len);
+}
+
+
+/*
+ * Check the whole file once, so that it can be used without any
+ * further checks afterwards.
+ */
+static gboolean
+cache_validate(const gchar *contents,
+               const gsize len)
+{
+    const cache_header *header = (const cache_header *) contents;
+    const cache_astro *astros;
+    const cache_timeslice *timeslices;
+    guint64 expected;
+    guint i;
+
+    if (len < sizeof(cache_header) ||
+        memcmp(header->magic, CACHE_MAGIC, CACHE_MAGIC_LEN) ||
+        header->version != CACHE_VERSION ||
+        header->byte_order != CACHE_BYTE_ORDER ||
+        header->num_values != LOC_VALUES_NUM)
+        return FALSE;
+
+    expected = sizeof(cache_header)
+        + (guint64) header->num_astro * sizeof(cache_astro)
+        + (guint64) header->num_timeslices * sizeof(cache_timeslice)
+        + header->strings_len;
+    if (expected != len)
+        return FALSE;
+
+    /* the string block must be terminated, so that every valid
+       offset points to a terminated string */
+    if (header->strings_len == 0 || contents[len - 1] != '\0')
+        return FALSE;
+
+    if (header->location_name == CACHE_NO_STRING ||
+        header->lat == CACHE_NO_STRING ||
+        header->lon == CACHE_NO_STRING ||
+        header->offset == CACHE_NO_STRING ||
+        !cache_string_is_valid(header, header->location_name) ||
+        !cache_string_is_valid(header, header->lat) ||
+        !cache_string_is_valid(header, header->lon) ||
+        !cache_string_is_valid(header, header->offset) ||
+        !cache_string_is_valid(header, header->weather_url) ||
+        !cache_string_is_valid(header, header->astro_url))
+        return FALSE;
+
+    astros = (const cache_astro *) (contents + sizeof(cache_header));
+    for (i = 0; i < header->num_astro; i++)
+        if (!cache_string_is_valid(header, astros[i].moon_phase))
+            return FALSE;
+
+    timeslices = (const cache_timeslice *) (astros + header->num_astro);
+    for (i = 0; i < header->num_timeslices; i++)
+        if (!cache_string_is_valid(header, timeslices[i].temperature_unit) ||
+            !cache_string_is_valid(header, timeslices[i].wind_dir_name) ||
+            !cache_string_is_valid(header, timeslices[i].humidity_unit) ||
+            !cache_string_is_valid(header, timeslices[i].pressure_unit) ||
+            !cache_string_is_valid(header, timeslices[i].precipitation_unit) ||
+            !cache_string_is_valid(header, timeslices[i].symbol))
+            return FALSE;
+
+    return TRUE;
+}
+
+
+/* check the cached data matches the current parameters */
+static gboolean
+cache_matches(const cache_header *header,
+              const gchar *strings,
+              const weather_cache_info *info,
+              const gint max_age)
+{
+    time_t now_t = time(NULL);
+
+    if (g_strcmp0(CACHE_STRING(strings, header->lat), info->lat) ||
+        g_strcmp0(CACHE_STRING(strings, header->lon), info->lon) ||
+        g_strcmp0(CACHE_STRING(strings, header->offset), info->offset) ||
+        header->msl != info->msl || header->num_timeslices < 1) {
+        weather_debug("The cache file does not match the current plugin "
+                      "data. Reading cache file aborted.");
+        return FALSE;
+    }
+    if (difftime(now_t, header->cache_date) > max_age) {
+        weather_debug("Cache file is too old and will not be used.");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+static void
+cache_merge_astrodata(const cache_astro *astros,
+                      const guint num_astro,
+                      const gchar *strings,
+                      GArray *astrodata)
+{
+    xml_astro astro;
+    guint i;
+
+    if (num_astro > 0)
+        weather_debug("Reusing cached astrodata instead of downloading it.");
+
+    /* astrodata is merged from stack copies, as merge_astro() copies
+       it anyway */
+    for (i = 0; i < num_astro; i++) {
+        memset(&astro, 0, sizeof(astro));
+        astro.day = astros[i].day;
+        astro.sunrise = astros[i].sunrise;
+        astro.sunset = astros[i].sunset;
+        astro.moonrise = astros[i].moonrise;
+        astro.moonset = astros[i].moonset;
+        astro.solarnoon_elevation = astros[i].solarnoon_elevation;
+        astro.solarmidnight_elevation = astros[i].solarmidnight_elevation;
+        astro.sun_never_rises = (astros[i].flags & CACHE_SUN_NEVER_RISES) != 0;
+        astro.sun_never_sets = (astros[i].flags & CACHE_SUN_NEVER_SETS) != 0;
+        astro.moon_never_rises =
+            (astros[i].flags & CACHE_MOON_NEVER_RISES) != 0;
+        astro.moon_never_sets = (astros[i].flags & CACHE_MOON_NEVER_SETS) != 0;
+        astro.moon_phase =
+            (gchar *) CACHE_STRING(strings, astros[i].moon_phase);
+        merge_astro(astrodata, &astro);
+    }
+}
+
+
+static void
+cache_merge_timeslices(const cache_timeslice *timeslices,
+                       const guint num_timeslices,
+                       const gchar *strings,
+                       xml_weather *wd)
+{
+    xml_time timeslice;
+    xml_location loc;
+    guint i;
+
+    /* timeslices are merged from stack copies, as merge_timeslice()
+       copies them anyway */
+    timeslice.location = &loc;
+    for (i = 0; i < num_timeslices; i++) {
+        timeslice.start = timeslices[i].start;
+        timeslice.end = timeslices[i].end;
+        timeslice.point = timeslices[i].point;
+        memcpy(loc.values, timeslices[i].values, sizeof(loc.values));
+        loc.valid = timeslices[i].valid & ((1u << LOC_VALUES_NUM) - 1);
+        loc.symbol_id = timeslices[i].symbol_id;
+        loc.temperature_unit =
+            CACHE_INTERNED(strings, timeslices[i].temperature_unit);
+        loc.wind_dir_name = CACHE_INTERNED(strings, timeslices[i].wind_dir_name);
+        loc.humidity_unit = CACHE_INTERNED(strings, timeslices[i].humidity_unit);
+        loc.pressure_unit = CACHE_INTERNED(strings, timeslices[i].pressure_unit);
+        loc.precipitation_unit =
+            CACHE_INTERNED(strings, timeslices[i].precipitation_unit);
+        loc.symbol = CACHE_INTERNED(strings, timeslices[i].symbol);
+        merge_timeslice(wd, &timeslice);
+    }
+}
+
+
+/*
+ * Read a cache file and merge its data into astrodata and wd, if it
+ * has been written for the location given in info and is not older
+ * than max_age seconds. Both astrodata and wd may be NULL to only
+ * read info. Returns WEATHER_CACHE_NOT_BINARY if the file exists but
+ * is not in the binary format, so that the caller may try to read it
+ * in the old key file format. On success, the URLs in info are newly
+ * allocated and need to be freed by the caller.
+ */
+weather_cache_status
+weather_cache_read(const gchar *file,
+                   weather_cache_info *info,
+                   const gint max_age,
+                   GArray *astrodata,
+                   xml_weather *wd)
+{
+    GMappedFile *mapped;
+    const gchar *contents, *strings;
+    const cache_header *header;
+    const cache_astro *astros;
+    weather_cache_status status = WEATHER_CACHE_UNUSABLE;
+    profile_mark mark;
+    gsize len;
+
+    g_assert(file != NULL && info != NULL);
+    if (G_UNLIKELY(file == NULL || info == NULL))
+        return WEATHER_CACHE_UNUSABLE;
+
+    weather_profile_begin(&mark);
+    mapped = g_mapped_file_new(file, FALSE, NULL);
+    if (mapped == NULL) {
+        weather_debug("Could not read cache file %s.", file);
+        return WEATHER_CACHE_UNUSABLE;
+    }
+    contents = g_mapped_file_get_contents(mapped);
+    len = g_mapped_file_get_length(mapped);
+
+    if (contents == NULL || len < CACHE_MAGIC_LEN ||
+        memcmp(contents, CACHE_MAGIC, CACHE_MAGIC_LEN))
+        status = WEATHER_CACHE_NOT_BINARY;
+    else if (!cache_validate(contents, len))
+        weather_debug("Cache file %s is invalid or has been written by "
+                      "another version.", file);
+    else {
+        weather_debug("Reading cache file %s.", file);
+        header = (const cache_header *) contents;
+        astros = (const cache_astro *) (contents + sizeof(cache_header));
+        strings = contents + len - header->strings_len;
+
+        if (cache_matches(header, strings, info, max_age)) {
+            info->cache_date = header->cache_date;
+            info->last_weather_download = header->last_weather_download;
+            info->last_astro_download = header->last_astro_download;
+            info->weather_expires = header->weather_expires;
+            info->weather_last_modified = header->weather_last_modified;
+            info->astro_expires = header->astro_expires;
+            info->astro_last_modified = header->astro_last_modified;
+            info->weather_url =
+                g_strdup(CACHE_STRING(strings, header->weather_url));
+            info->astro_url =
+                g_strdup(CACHE_STRING(strings, header->astro_url));
+            if (astrodata)
+                cache_merge_astrodata(astros, header->num_astro,
+                                      strings, astrodata);
+            if (wd)
+                cache_merge_timeslices((const cache_timeslice *)
+                                       (astros + header->num_astro),
+                                       header->num_timeslices, strings, wd);
+            status = WEATHER_CACHE_OK;
+            weather_debug("Reading cache file complete.");
+        }
+    }
+
+    g_mapped_file_unref(mapped);
+    weather_profile_end(PROFILE_CACHE_READ, &mark);
+    return status;
+}
+
+
+/*
+ * Take the download lock of a cache file. Plugin instances showing the
+ * same location share the cache file, and only the one holding the
+ * lock downloads new data. Returns FALSE if another instance holds the
+ * lock. Otherwise fd is set to the lock to be released with
+ * weather_cache_unlock(), or to -1 if locking is not possible, in
+ * which case the caller should download anyway.
+ */
+gboolean
+weather_cache_lock(const gchar *file,
+                   gint *fd)
+{
+    gchar *lockfile;
+    gint lock_fd, err;
+
+    g_assert(file != NULL && fd != NULL);
+    *fd = -1;
+    if (G_UNLIKELY(file == NULL))
+        return TRUE;
+
+    lockfile = g_strconcat(file, ".lock", NULL);
+    lock_fd = open(lockfile, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (lock_fd < 0) {
+        weather_debug("Could not open lock file %s: %s",
+                      lockfile, g_strerror(errno));
+        g_free(lockfile);
+        return TRUE;
+    }
+    g_free(lockfile);
+
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) < 0) {
+        err = errno;
+        close(lock_fd);
+        if (err == EWOULDBLOCK)
+            return FALSE;
+        weather_debug("Could not lock cache file %s: %s",
+                      file, g_strerror(err));
+        return TRUE;
+    }
+    *fd = lock_fd;
+    return TRUE;
+}
+
+
+void
+weather_cache_unlock(gint fd)
+{
+    /* closing the file releases the lock */
+    if (fd >= 0)
+        close(fd);
+}
+
+
+static void
+cache_write_free(gpointer data)
+{
+    cache_write *entry = data;
+
+    weather_cache_unlock(entry->lock_fd);
+    g_bytes_unref(entry->contents);
+    g_slice_free(cache_write, entry);
+}
+
+
+/* runs in the worker thread */
+static void
+cache_writer_run(gpointer job,
+                 gpointer user_data)
+{
+    weather_cache_writer *writer = user_data;
+    cache_write *entry = NULL;
+    gpointer key;
+    GError *error = NULL;
+    gconstpointer buf;
+    gchar *file = job;
+    gsize len;
+
+    g_mutex_lock(&writer->lock);
+    if (g_hash_table_lookup_extended(writer->pending, file,
+                                     &key, (gpointer *) &entry)) {
+        g_hash_table_steal(writer->pending, file);
+        g_free(key);
+    }
+    g_mutex_unlock(&writer->lock);
+
+    if (G_UNLIKELY(entry == NULL)) {
+        g_free(file);
+        return;
+    }
+
+    buf = g_bytes_get_data(entry->contents, &len);
+    if (!g_file_set_contents(file, buf, len, &error)) {
+        g_warning(_("Error writing cache file %s!"), file);
+        weather_debug("%s", error ? error->message : "");
+        g_clear_error(&error);
+    } else
+        weather_debug("Cache file %s has been written.", file);
+
+    /* other instances waiting for the download may read it now */
+    cache_write_free(entry);
+    g_free(file);
+}
+
+
+weather_cache_writer *
+weather_cache_writer_new(void)
+{
+    weather_cache_writer *writer;
+
+    writer = g_slice_new0(weather_cache_writer);
+    g_mutex_init(&writer->lock);
+    writer->pending = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                            g_free, cache_write_free);
+
+    /* a single thread, so that writes never overlap */
+    writer->pool = g_thread_pool_new(cache_writer_run, writer,
+                                     1, FALSE, NULL);
+    return writer;
+}
+
+
+/*
+ * Queue contents to be written to file. If an earlier write to the
+ * same file has not been started yet, it is dropped in favour of the
+ * new contents; writes to other files are queued after it. The writer
+ * takes over lock_fd, if it is not -1, and releases it once the file
+ * has been written, so that other plugin instances waiting for the
+ * lock do not read the previous contents.
+ */
+void
+weather_cache_writer_write(weather_cache_writer *writer,
+                           const gchar *file,
+                           GBytes *contents,
+                           gint lock_fd)
+{
+    cache_write *entry;
+
+    g_assert(writer != NULL);
+    if (G_UNLIKELY(writer == NULL || file == NULL || contents == NULL)) {
+        weather_cache_unlock(lock_fd);
+        return;
+    }
+
+    g_mutex_lock(&writer->lock);
+    entry = g_hash_table_lookup(writer->pending, file);
+    if (entry) {
+        /* the queued job will pick up the new contents */
+        weather_debug("Replacing pending write of cache file %s.", file);
+        g_bytes_unref(entry->contents);
+        entry->contents = g_bytes_ref(contents);
+        if (lock_fd >= 0) {
+            weather_cache_unlock(entry->lock_fd);
+            entry->lock_fd = lock_fd;
+        }
+        g_mutex_unlock(&writer->lock);
+        return;
+    }
+    entry = g_slice_new0(cache_write);
+    entry->contents = g_bytes_ref(contents);
+    entry->lock_fd = lock_fd;
+    g_hash_table_insert(writer->pending, g_strdup(file), entry);
+    g_mutex_unlock(&writer->lock);
+
+    g_thread_pool_push(writer->pool, g_strdup(file), NULL);
+}
+
+
+/*
+ * Free the writer after waiting for pending writes to finish.
+ */
+void
+weather_cache_writer_free(weather_cache_writer *writer)
+{
+    if (G_UNLIKELY(writer == NULL))
+        return;
+
+    weather_debug("Waiting for pending cache writes.");
+    g_thread_pool_free(writer->pool, FALSE, TRUE);
+    g_hash_table_destroy(writer->pending);
+    g_mutex_clear(&writer->lock);
+    g_slice_free(weather_cache_writer, writer);
+}
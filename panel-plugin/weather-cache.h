@@ -0,0 +1,93 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __WEATHER_CACHE_H__
+#define __WEATHER_CACHE_H__
+
+#include <glib.h>
+
+#include "weather-parsers.h"
+
+G_BEGIN_DECLS
+
+/* wait for another instance's download */
+#define SHARED_DOWNLOAD_WAIT (30)
+
+typedef struct _weather_cache_writer weather_cache_writer;
+
+typedef enum {
+    WEATHER_CACHE_OK,
+    WEATHER_CACHE_UNUSABLE,
+    WEATHER_CACHE_NOT_BINARY
+} weather_cache_status;
+
+/*
+ * Information stored along with the cached data. When reading, the
+ * location fields need to be set and are compared to the cached
+ * ones, and the times are filled in.
+ */
+typedef struct {
+    const gchar *location_name;
+    const gchar *lat;
+    const gchar *lon;
+    const gchar *offset;
+    gint msl;
+
+    time_t cache_date;
+    time_t last_weather_download;
+    time_t last_astro_download;
+
+    /* HTTP caching information, 0 if unknown */
+    time_t weather_expires;
+    time_t weather_last_modified;
+    time_t astro_expires;
+    time_t astro_last_modified;
+
+    /* URLs the last modification times belong to */
+    gchar *weather_url;
+    gchar *astro_url;
+} weather_cache_info;
+
+
+GBytes *weather_cache_serialize(const weather_cache_info *info,
+                                const GArray *astrodata,
+                                const xml_weather *wd);
+
+weather_cache_status weather_cache_read(const gchar *file,
+                                        weather_cache_info *info,
+                                        gint max_age,
+                                        GArray *astrodata,
+                                        xml_weather *wd);
+
+gboolean weather_cache_lock(const gchar *file,
+                            gint *fd);
+
+void weather_cache_unlock(gint fd);
+
+weather_cache_writer *weather_cache_writer_new(void);
+
+void weather_cache_writer_write(weather_cache_writer *writer,
+                                const gchar *file,
+                                GBytes *contents,
+                                gint lock_fd);
+
+void weather_cache_writer_free(weather_cache_writer *writer);
+
+G_END_DECLS
+
+#endif
@@ -0,0 +1,458 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Headless driver for the data pipeline of the plugin, meant for
+ * profiling without a running panel. It reads met.no responses from
+ * files or URLs (e.g. of a local server replaying recorded data),
+ * optionally merges and writes a cache file, and prints the current
+ * conditions and the forecast grid. In replay mode, a whole day of
+ * current conditions updates is run through as fast as possible.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+#include <stdio.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "weather-parsers.h"
+#include "weather-data.h"
+#include "weather.h"
+#include "weather-cache.h"
+#include "weather-translate.h"
+#include "weather-debug.h"
+
+#define REPLAY_STEP (5 * 60)
+#define REPLAY_TICKS (24 * 3600 / REPLAY_STEP)
+
+
+gboolean debug_mode = FALSE;
+
+static gchar *forecast_source = NULL;
+static gchar *astro_source = NULL;
+static gchar *cache_file = NULL;
+static gchar *lat = NULL;
+static gchar *lon = NULL;
+static gchar *offset = NULL;
+static gint msl = 0;
+static gint days = 5;
+static gint replays = 0;
+static gboolean quiet = FALSE;
+
+static GOptionEntry entries[] = {
+    { "forecast", 'f', 0, G_OPTION_ARG_STRING, &forecast_source,
+      "Read locationforecast data from FILE or URL", "FILE|URL" },
+    { "astro", 'a', 0, G_OPTION_ARG_STRING, &astro_source,
+      "Read sunrise data from FILE or URL", "FILE|URL" },
+    { "cache", 'c', 0, G_OPTION_ARG_FILENAME, &cache_file,
+      "Read and update the cache FILE", "FILE" },
+    { "lat", 0, 0, G_OPTION_ARG_STRING, &lat,
+      "Latitude stored in the cache file", "LAT" },
+    { "lon", 0, 0, G_OPTION_ARG_STRING, &lon,
+      "Longitude stored in the cache file", "LON" },
+    { "msl", 0, 0, G_OPTION_ARG_INT, &msl,
+      "Altitude stored in the cache file", "METERS" },
+    { "offset", 0, 0, G_OPTION_ARG_STRING, &offset,
+      "Timezone offset stored in the cache file", "OFFSET" },
+    { "days", 'd', 0, G_OPTION_ARG_INT, &days,
+      "Number of forecast days", "N" },
+    { "replay", 'r', 0, G_OPTION_ARG_INT, &replays,
+      "Replay a day of 5-minute updates N times", "N" },
+    { "quiet", 'q', 0, G_OPTION_ARG_NONE, &quiet,
+      "Do not print the data", NULL },
+    { "debug", 0, 0, G_OPTION_ARG_NONE, &debug_mode,
+      "Print debug messages and a profile", NULL },
+    { NULL }
+};
+
+static const struct {
+    data_types type;
+    const gchar *name;
+} values[] = {
+    { TEMPERATURE, "temperature" },
+    { APPARENT_TEMPERATURE, "apparent temperature" },
+    { DEWPOINT, "dew point" },
+    { PRESSURE, "pressure" },
+    { HUMIDITY, "humidity" },
+    { WIND_SPEED, "wind speed" },
+    { WIND_BEAUFORT, "wind (Beaufort)" },
+    { WIND_DIRECTION, "wind direction" },
+    { WIND_DIRECTION_DEG, "wind direction (degrees)" },
+    { CLOUDS_LOW, "low clouds" },
+    { CLOUDS_MID, "middle clouds" },
+    { CLOUDS_HIGH, "high clouds" },
+    { CLOUDINESS, "cloudiness" },
+    { FOG, "fog" },
+    { PRECIPITATION, "precipitation" }
+};
+
+static const gchar *daytime_names[] = {
+    "morning", "afternoon", "evening", "night"
+};
+
+
+/*
+ * Get the contents of a file, or download them if source is an URL,
+ * so that a local server can stand in for met.no.
+ */
+static gchar *
+load_source(const gchar *source,
+            gsize *len)
+{
+    SoupSession *session;
+    SoupMessage *msg;
+    GError *error = NULL;
+    gchar *contents = NULL;
+
+    if (!g_str_has_prefix(source, "http://") &&
+        !g_str_has_prefix(source, "https://")) {
+        if (!g_file_get_contents(source, &contents, len, &error)) {
+            g_printerr("%s\n", error->message);
+            g_error_free(error);
+        }
+        return contents;
+    }
+
+    session = soup_session_new();
+    msg = soup_message_new("GET", source);
+    if (G_UNLIKELY(msg == NULL))
+        g_printerr("Invalid URL %s\n", source);
+    else if (soup_session_send_message(session, msg) != SOUP_STATUS_OK)
+        g_printerr("Download of %s failed with HTTP status code %u\n",
+                   source, msg->status_code);
+    else {
+        *len = msg->response_body->length;
+        contents = g_strndup(msg->response_body->data, *len);
+    }
+    if (msg)
+        g_object_unref(msg);
+    g_object_unref(session);
+    return contents;
+}
+
+
+static gboolean
+read_weather(const gchar *source,
+             xml_weather *wd)
+{
+    gchar *contents;
+    gsize len = 0;
+    gboolean result;
+
+    contents = load_source(source, &len);
+    if (contents == NULL)
+        return FALSE;
+    result = parse_weather_buffer(contents, len, wd);
+    g_free(contents);
+    return result;
+}
+
+
+static gboolean
+read_astro(const gchar *source,
+           GArray *astrodata)
+{
+    xmlDoc *doc;
+    xmlNode *root_node, *child_node;
+    gchar *contents;
+    gsize len = 0;
+    gboolean result = FALSE;
+
+    contents = load_source(source, &len);
+    if (contents == NULL)
+        return FALSE;
+
+    doc = xmlReadMemory(contents, len, NULL,
+                        g_utf8_validate(contents, len, NULL)
+                        ? "UTF-8" : NULL, 0);
+    g_free(contents);
+    if (G_UNLIKELY(doc == NULL))
+        return FALSE;
+
+    root_node = xmlDocGetRootElement(doc);
+    if (G_LIKELY(root_node))
+        for (child_node = root_node->children; child_node;
+             child_node = child_node->next)
+            if (child_node->type == XML_ELEMENT_NODE &&
+                parse_astrodata(child_node, astrodata))
+                result = TRUE;
+    xmlFreeDoc(doc);
+
+    astrodata_clean(astrodata);
+    g_array_sort(astrodata, (GCompareFunc) xml_astro_compare);
+    return result;
+}
+
+
+static void
+init_cache_info(weather_cache_info *info)
+{
+    memset(info, 0, sizeof(*info));
+    info->location_name = "weather-cli";
+    info->lat = lat;
+    info->lon = lon;
+    info->offset = offset;
+    info->msl = msl;
+}
+
+
+static void
+write_cache(const gchar *file,
+            GArray *astrodata,
+            xml_weather *wd)
+{
+    weather_cache_info info;
+    GError *error = NULL;
+    GBytes *contents;
+    gconstpointer buf;
+    gsize len;
+
+    init_cache_info(&info);
+    info.cache_date = time(NULL);
+    info.last_weather_download = info.cache_date;
+    info.last_astro_download = info.cache_date;
+
+    contents = weather_cache_serialize(&info, astrodata, wd);
+    if (G_UNLIKELY(contents == NULL))
+        return;
+    buf = g_bytes_get_data(contents, &len);
+    if (!g_file_set_contents(file, buf, len, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+    }
+    g_bytes_unref(contents);
+}
+
+
+static void
+print_conditions(const xml_time *conditions,
+                 const units_config *units,
+                 gboolean night_time)
+{
+    gchar *value, *start, *end;
+    guint i;
+
+    if (conditions == NULL) {
+        printf("No current conditions available.\n");
+        return;
+    }
+
+    start = format_date(conditions->start, "%Y-%m-%d %H:%M", TRUE);
+    end = format_date(conditions->end, "%H:%M", TRUE);
+    value = get_data(conditions, units, SYMBOL, FALSE, night_time);
+    printf("Current conditions (%s - %s): %s\n", start, end,
+           translate_desc(value, night_time));
+    g_free(value);
+    g_free(start);
+    g_free(end);
+
+    for (i = 0; i < G_N_ELEMENTS(values); i++) {
+        value = get_data(conditions, units, values[i].type, TRUE, night_time);
+        printf("  %-26s %s %s\n", values[i].name, value,
+               get_unit(units, values[i].type));
+        g_free(value);
+    }
+}
+
+
+static void
+print_forecast(const forecast_grid *grid,
+               const units_config *units)
+{
+    const xml_time *fcdata;
+    gchar *date, *symbol, *temp;
+    guint day;
+    daytime dt;
+
+    for (day = 0; day < grid->days; day++) {
+        date = format_date(day_at_midnight(time(NULL), day),
+                           "%a %Y-%m-%d", TRUE);
+        printf("%s\n", date);
+        g_free(date);
+        for (dt = MORNING; dt <= NIGHT; dt++) {
+            fcdata = forecast_grid_get(grid, day, dt);
+            if (fcdata == NULL) {
+                printf("  %-10s -\n", daytime_names[dt]);
+                continue;
+            }
+            symbol = get_data(fcdata, units, SYMBOL, FALSE, dt == NIGHT);
+            temp = get_data(fcdata, units, TEMPERATURE, TRUE, dt == NIGHT);
+            printf("  %-10s %s %s, %s\n", daytime_names[dt], temp,
+                   get_unit(units, TEMPERATURE),
+                   translate_desc(symbol, dt == NIGHT));
+            g_free(symbol);
+            g_free(temp);
+        }
+    }
+}
+
+
+/*
+ * Run through the updates the plugin does in a day: current
+ * conditions every 5 minutes and the forecast grid every hour,
+ * including the formatting of all values.
+ */
+static void
+replay_day(xml_weather *wd,
+           GArray *astrodata,
+           const units_config *units,
+           time_t start_t)
+{
+    forecast_grid *grid;
+    xml_time *conditions;
+    xml_astro *astro;
+    gchar *value;
+    time_t tick_t;
+    guint tick, i;
+    gboolean night_time;
+
+    /* start from fresh data like after a download, so that every
+       replay goes through the same searches as the plugin */
+    xml_weather_invalidate(wd);
+
+    for (tick = 0; tick < REPLAY_TICKS; tick++) {
+        tick_t = start_t + tick * REPLAY_STEP;
+        astro = get_astro(astrodata, day_at_midnight(tick_t, 0), NULL);
+        night_time = is_night_time(astro);
+
+        conditions = make_current_conditions(wd, tick_t);
+        for (i = 0; conditions && i < G_N_ELEMENTS(values); i++) {
+            value = get_data(conditions, units, values[i].type,
+                             TRUE, night_time);
+            g_free(value);
+        }
+        if (conditions)
+            xml_time_free(conditions);
+
+        if (tick % (3600 / REPLAY_STEP) == 0) {
+            grid = make_forecast_grid(wd, days);
+            forecast_grid_free(grid);
+        }
+    }
+}
+
+
+int
+main(int argc,
+     char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    xml_weather *wd;
+    GArray *astrodata;
+    weather_cache_info info;
+    units_config units;
+    forecast_grid *grid;
+    xml_astro *astro;
+    gchar *profile;
+    time_t now_t, start_t;
+    gboolean night_time;
+    gint i;
+
+    xfce_textdomain(GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR, "UTF-8");
+
+    context = g_option_context_new("- run the weather plugin data pipeline");
+    g_option_context_add_main_entries(context, entries, NULL);
+    if (!g_option_context_parse(context, &argc, &argv, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    if (forecast_source == NULL && cache_file == NULL) {
+        g_printerr("Need weather data, use --forecast or --cache.\n");
+        return 1;
+    }
+    if (lat == NULL)
+        lat = g_strdup("0");
+    if (lon == NULL)
+        lon = g_strdup("0");
+    if (offset == NULL)
+        offset = g_strdup("+00:00");
+    if (days < 1)
+        days = 1;
+
+    weather_debug_init(G_LOG_DOMAIN, debug_mode);
+
+    wd = make_weather_data();
+    astrodata = g_array_sized_new(FALSE, TRUE, sizeof(xml_astro *), 30);
+
+    if (cache_file) {
+        init_cache_info(&info);
+        if (weather_cache_read(cache_file, &info, G_MAXINT,
+                               astrodata, wd) != WEATHER_CACHE_OK)
+            g_printerr("Could not use cache file %s.\n", cache_file);
+        g_free(info.weather_url);
+        g_free(info.astro_url);
+    }
+    if (forecast_source && !read_weather(forecast_source, wd))
+        g_printerr("Error parsing weather data!\n");
+    if (astro_source && !read_astro(astro_source, astrodata))
+        g_printerr("Error parsing astronomical data!\n");
+    xml_weather_clean(wd);
+
+    memset(&units, 0, sizeof(units));
+    units.temperature = CELSIUS;
+    units.apparent_temperature = STEADMAN;
+    units.pressure = HECTOPASCAL;
+    units.windspeed = KMH;
+    units.precipitation = MILLIMETERS;
+    units.altitude = METERS;
+
+    /* the plugin calculates conditions at exact 5 minute intervals */
+    now_t = time(NULL);
+    start_t = now_t - now_t % REPLAY_STEP;
+    astro = get_astro_data_for_day(astrodata, 0);
+    night_time = is_night_time(astro);
+    wd->current_conditions = make_current_conditions(wd, start_t);
+    grid = make_forecast_grid(wd, days);
+    if (!quiet) {
+        print_conditions(wd->current_conditions, &units, night_time);
+        print_forecast(grid, &units);
+    }
+    forecast_grid_free(grid);
+
+    for (i = 0; i < replays; i++)
+        replay_day(wd, astrodata, &units, start_t);
+
+    if (cache_file)
+        write_cache(cache_file, astrodata, wd);
+
+    if (debug_mode) {
+        profile = weather_dump_profile();
+        printf("%s\n", profile);
+        g_free(profile);
+    }
+
+    astrodata_free(astrodata);
+    xml_weather_free(wd);
+    xmlCleanupParser();
+    g_free(forecast_source);
+    g_free(astro_source);
+    g_free(cache_file);
+    g_free(lat);
+    g_free(lon);
+    g_free(offset);
+    return 0;
+}
@@ -427,6 +427,7 @@ text_loc_name_changed(const GtkWidget *spin,
     g_free(dialog->pd->location_name);
     dialog->pd->location_name =
         g_strdup(gtk_entry_get_text(GTK_ENTRY(dialog->text_loc_name)));
+    invalidate_tooltip(dialog->pd);
 }
 
 
@@ -971,6 +972,7 @@ combo_tooltip_style_changed(GtkWidget *combo,
 {
     xfceweather_dialog *dialog = (xfceweather_dialog *) user_data;
     dialog->pd->tooltip_style = gtk_combo_box_get_active(GTK_COMBO_BOX(combo));
+    invalidate_tooltip(dialog->pd);
 }
 
 
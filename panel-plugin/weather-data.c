@@ -32,10 +32,14 @@
 #define NIGHT_TIME_START 21
 #define NIGHT_TIME_END 5
 
-/* interval used for searching raw data relevant to a day */
+/* daytimes are DAYTIME_LEN hours long intervals around a point,
+   starting at DAY_START hours into the day */
 #define DAY_START 3
-#define DAY_END 33
 #define DAYTIME_LEN 6
+#define DAYTIMES (NIGHT + 1)
+
+/* hour of a point in time in UTC, like gmtime() would return it */
+#define UTC_HOUR(t) ((gint) (((t) / 3600) % 24))
 
 /* If some value is not present or cannot be computed, return this instead */
 #define INVALID_VALUE -9999
@@ -53,31 +57,24 @@ do {                                                     \
         temperature = 0;                                 \
 } while (0)
 
-#define LOCALE_DOUBLE(value, format)                        \
-    (value                                                  \
-     ? g_strdup_printf(format, g_ascii_strtod(value, NULL)) \
+#define LOCALE_DOUBLE(loc, value, format)                   \
+    (LOC_HAS(loc, value)                                    \
+     ? g_strdup_printf(format, (loc)->values[value])        \
      : g_strdup(""))
 
-#define INTERPOLATE_OR_COPY(var, radian)                    \
-    if (ipol)                                               \
-        comb->location->var =                               \
-            interpolate_gchar_value(start->location->var,   \
-                                    end->location->var,     \
-                                    comb->start, comb->end, \
-                                    comb->point, radian);   \
-    else                                                    \
-        comb->location->var = g_strdup(end->location->var);
-
-#define COMB_END_COPY(var)                              \
-    comb->location->var = g_strdup(end->location->var);
+#define INTERPOLATE_OR_COPY(value, radian)                      \
+    if (ipol)                                                   \
+        interpolate_location_value(comb->location,              \
+                                   start->location,             \
+                                   end->location, value,        \
+                                   comb->start, comb->end,      \
+                                   comb->point, radian);        \
+    else                                                        \
+        COMB_END_COPY(value);
 
-
-/* struct to store results from searches for point data */
-typedef struct {
-    GArray *before;
-    time_t point;
-    GArray *after;
-} point_data_results;
+#define COMB_END_COPY(value)                                    \
+    if (LOC_HAS(end->location, value))                          \
+        LOC_SET(comb->location, value, end->location->values[value]);
 
 
 /* convert string to a double value, returning backup value on error */
@@ -134,7 +131,7 @@ gboolean
 timeslice_is_interval(xml_time *timeslice)
 {
     return (timeslice->location->symbol != NULL ||
-            timeslice->location->precipitation_value != NULL);
+            LOC_HAS(timeslice->location, LOC_PRECIPITATION));
 }
 
 
@@ -147,11 +144,11 @@ calc_dewpoint(const xml_location *loc)
 {
     gdouble temp, humidity, val;
 
-    if (G_UNLIKELY(loc->humidity_value == NULL))
+    if (G_UNLIKELY(!LOC_HAS(loc, LOC_HUMIDITY)))
         return INVALID_VALUE;
 
-    temp = string_to_double(loc->temperature_value, 0);
-    humidity = string_to_double(loc->humidity_value, 0);
+    temp = loc->values[LOC_TEMPERATURE];
+    humidity = loc->values[LOC_HUMIDITY];
     val = log(humidity / 100);
     return (241.2 * val + 4222.03716 * temp / (241.2 + temp))
         / (17.5043 - val - 17.5043 * temp / (241.2 + temp));
@@ -164,9 +161,9 @@ calc_apparent_temperature(const xml_location *loc,
                           const apparent_temp_models model,
                           const gboolean night_time)
 {
-    gdouble temp = string_to_double(loc->temperature_value, 0);
-    gdouble windspeed = string_to_double(loc->wind_speed_mps, 0);
-    gdouble humidity = string_to_double(loc->humidity_value, 0);
+    gdouble temp = loc->values[LOC_TEMPERATURE];
+    gdouble windspeed = loc->values[LOC_WIND_SPEED_MPS];
+    gdouble humidity = loc->values[LOC_HUMIDITY];
     gdouble dp, e;
 
     switch (model) {
@@ -279,15 +276,16 @@ calc_apparent_temperature(const xml_location *loc,
  * Return wind direction name for wind degrees, which gives the
  * direction the wind is coming _from_.
  */
-static gchar*
-wind_dir_name_by_deg(gchar *degrees, gboolean long_name)
+static const gchar *
+wind_dir_name_by_deg(const xml_location *loc,
+                     gboolean long_name)
 {
     gdouble deg;
 
-    if (G_UNLIKELY(degrees == NULL))
+    if (G_UNLIKELY(!LOC_HAS(loc, LOC_WIND_DIR_DEG)))
         return "";
 
-    deg = string_to_double(degrees, 0);
+    deg = loc->values[LOC_WIND_DIR_DEG];
 
     if (deg >= 360 - 22.5 || deg < 45 - 22.5)
         return (long_name) ? _("North") : _("N");
@@ -336,29 +334,29 @@ get_data(const xml_time *timeslice,
     case ALTITUDE:
         switch (units->altitude) {
         case METERS:
-            return LOCALE_DOUBLE(loc->altitude, "%.0f");
+            return LOCALE_DOUBLE(loc, LOC_ALTITUDE, "%.0f");
 
         case FEET:
-            val = string_to_double(loc->altitude, 0);
+            val = loc->values[LOC_ALTITUDE];
             val /= 0.3048;
             return g_strdup_printf(ROUND_TO_INT("%.2f"), val);
         }
         break;
 
     case LATITUDE:
-        return LOCALE_DOUBLE(loc->latitude, "%.4f");
+        return LOCALE_DOUBLE(loc, LOC_LATITUDE, "%.4f");
 
     case LONGITUDE:
-        return LOCALE_DOUBLE(loc->longitude, "%.4f");
+        return LOCALE_DOUBLE(loc, LOC_LONGITUDE, "%.4f");
 
     case TEMPERATURE:      /* source is in °C */
-        val = string_to_double(loc->temperature_value, 0);
+        val = loc->values[LOC_TEMPERATURE];
         if (units->temperature == FAHRENHEIT)
             CALC_FAHRENHEIT(round, val);
         return g_strdup_printf(ROUND_TO_INT("%.1f"), val);
 
     case PRESSURE:         /* source is in hectopascals */
-        val = string_to_double(loc->pressure_value, 0);
+        val = loc->values[LOC_PRESSURE];
         switch (units->pressure) {
         case INCH_MERCURY:
             val *= 0.03;
@@ -373,7 +371,7 @@ get_data(const xml_time *timeslice,
         return g_strdup_printf(ROUND_TO_INT("%.1f"), val);
 
     case WIND_SPEED:       /* source is in meters per hour */
-        val = string_to_double(loc->wind_speed_mps, 0);
+        val = loc->values[LOC_WIND_SPEED_MPS];
         switch (units->windspeed) {
         case KMH:
             val *= 3.6;
@@ -391,17 +389,17 @@ get_data(const xml_time *timeslice,
         return g_strdup_printf(ROUND_TO_INT("%.1f"), val);
 
     case WIND_BEAUFORT:
-        val = string_to_double(loc->wind_speed_beaufort, 0);
+        val = loc->values[LOC_WIND_SPEED_BEAUFORT];
         return g_strdup_printf("%.0f", val);
 
     case WIND_DIRECTION:
-        return g_strdup(wind_dir_name_by_deg(loc->wind_dir_deg, FALSE));
+        return g_strdup(wind_dir_name_by_deg(loc, FALSE));
 
     case WIND_DIRECTION_DEG:
-        return LOCALE_DOUBLE(loc->wind_dir_deg, ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_WIND_DIR_DEG, ROUND_TO_INT("%.1f"));
 
     case HUMIDITY:
-        return LOCALE_DOUBLE(loc->humidity_value, ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_HUMIDITY, ROUND_TO_INT("%.1f"));
 
     case DEWPOINT:
         val = calc_dewpoint(loc);
@@ -419,26 +417,22 @@ get_data(const xml_time *timeslice,
         return g_strdup_printf(ROUND_TO_INT("%.1f"), val);
 
     case CLOUDS_LOW:
-        return LOCALE_DOUBLE(loc->clouds_percent[CLOUDS_PERC_LOW],
-                             ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_CLOUDS_LOW, ROUND_TO_INT("%.1f"));
 
     case CLOUDS_MID:
-        return LOCALE_DOUBLE(loc->clouds_percent[CLOUDS_PERC_MID],
-                             ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_CLOUDS_MID, ROUND_TO_INT("%.1f"));
 
     case CLOUDS_HIGH:
-        return LOCALE_DOUBLE(loc->clouds_percent[CLOUDS_PERC_HIGH],
-                             ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_CLOUDS_HIGH, ROUND_TO_INT("%.1f"));
 
     case CLOUDINESS:
-        return LOCALE_DOUBLE(loc->clouds_percent[CLOUDS_PERC_CLOUDINESS],
-                             ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_CLOUDINESS, ROUND_TO_INT("%.1f"));
 
     case FOG:
-        return LOCALE_DOUBLE(loc->fog_percent, ROUND_TO_INT("%.1f"));
+        return LOCALE_DOUBLE(loc, LOC_FOG, ROUND_TO_INT("%.1f"));
 
     case PRECIPITATION:   /* source is in millimeters */
-        val = string_to_double(loc->precipitation_value, 0);
+        val = loc->values[LOC_PRECIPITATION];
 
         /* For snow, adjust precipitation dependent on temperature. Source:
            http://answers.yahoo.com/question/index?qid=20061230123635AAAdZAe */
@@ -447,7 +441,7 @@ get_data(const xml_time *timeslice,
             loc->symbol_id == SYMBOL_SNOWTHUNDER ||
             loc->symbol_id == SYMBOL_SNOWSUNPOLAR ||
             loc->symbol_id == SYMBOL_SNOWSUNTHUNDER) {
-            temp = string_to_double(loc->temperature_value, 0);
+            temp = loc->values[LOC_TEMPERATURE];
             if (temp < -11.1111)      /* below 12 °F, low snow density */
                 val *= 12;
             else if (temp < -4.4444)  /* 12 to 24 °F, still low density */
@@ -594,15 +588,14 @@ calculate_symbol(xml_time *timeslice,
 
     loc = timeslice->location;
 
-    precipitation = string_to_double(loc->precipitation_value, 0);
+    precipitation = loc->values[LOC_PRECIPITATION];
     if (precipitation > 0)
         return;
 
     /* do some modifications only if we're making a timeslice for
        current conditions */
     if (current_conditions) {
-        cloudiness =
-            string_to_double(loc->clouds_percent[CLOUDS_PERC_CLOUDINESS], 0);
+        cloudiness = loc->values[LOC_CLOUDINESS];
         if (cloudiness >= 90)
             loc->symbol_id = SYMBOL_CLOUD;
         else if (cloudiness >= 30)
@@ -611,13 +604,12 @@ calculate_symbol(xml_time *timeslice,
             loc->symbol_id = SYMBOL_LIGHTCLOUD;
     }
 
-    fog = string_to_double(loc->fog_percent, 0);
+    fog = loc->values[LOC_FOG];
     if (fog >= 80)
         loc->symbol_id = SYMBOL_FOG;
 
     /* update symbol name */
-    g_free(loc->symbol);
-    loc->symbol = g_strdup(get_symbol_name(loc->symbol_id));
+    loc->symbol = get_symbol_name(loc->symbol_id);
 }
 
 
@@ -650,26 +642,31 @@ interpolate_value(gdouble value_start,
 
 
 /*
- * convert gchar in a gdouble and interpolate the value
+ * Interpolate a location value, copying the end value if there is no
+ * start value
  */
-static gchar *
-interpolate_gchar_value(gchar *value_start,
-                        gchar *value_end,
-                        time_t start_t,
-                        time_t end_t,
-                        time_t between_t,
-                        gboolean radian)
+static void
+interpolate_location_value(xml_location *comb,
+                           const xml_location *start,
+                           const xml_location *end,
+                           location_values value,
+                           time_t start_t,
+                           time_t end_t,
+                           time_t between_t,
+                           gboolean radian)
 {
     gdouble val_start, val_end, val_result;
 
-    if (G_UNLIKELY(value_end == NULL))
-        return NULL;
+    if (G_UNLIKELY(!LOC_HAS(end, value)))
+        return;
 
-    if (value_start == NULL)
-        return g_strdup(value_end);
+    if (!LOC_HAS(start, value)) {
+        LOC_SET(comb, value, end->values[value]);
+        return;
+    }
 
-    val_start = string_to_double(value_start, 0);
-    val_end = string_to_double(value_end, 0);
+    val_start = start->values[value];
+    val_end = end->values[value];
 
     if (radian) {
         if (val_end > val_start && val_end - val_start > 180)
@@ -685,7 +682,7 @@ interpolate_gchar_value(gchar *value_start,
 
     weather_debug("Interpolated data: start=%f, end=%f, result=%f",
                   val_start, val_end, val_result);
-    return double_to_string(val_result, "%.1f");
+    LOC_SET(comb, value, val_result);
 }
 
 
@@ -698,13 +695,12 @@ make_combined_timeslice(xml_weather *wd,
 {
     xml_time *comb, *start, *end;
     gboolean ipol = (between_t != NULL) ? TRUE : FALSE;
-    gint i;
 
     /* find point data at start of interval (may not be available) */
-    start = get_timeslice(wd, interval->start, interval->start, NULL);
+    start = get_timeslice(wd, interval->start, interval->start);
 
     /* find point interval at end of interval */
-    end = get_timeslice(wd, interval->end, interval->end, NULL);
+    end = get_timeslice(wd, interval->end, interval->end);
 
     if (start == NULL && end == NULL)
         return NULL;
@@ -736,38 +732,40 @@ make_combined_timeslice(xml_weather *wd,
     comb->start = interval->start;
     comb->end = interval->end;
 
-    COMB_END_COPY(altitude);
-    COMB_END_COPY(latitude);
-    COMB_END_COPY(longitude);
+    COMB_END_COPY(LOC_ALTITUDE);
+    COMB_END_COPY(LOC_LATITUDE);
+    COMB_END_COPY(LOC_LONGITUDE);
 
-    INTERPOLATE_OR_COPY(temperature_value, FALSE);
-    COMB_END_COPY(temperature_unit);
+    INTERPOLATE_OR_COPY(LOC_TEMPERATURE, FALSE);
+    comb->location->temperature_unit = end->location->temperature_unit;
 
-    INTERPOLATE_OR_COPY(wind_dir_deg, TRUE);
+    INTERPOLATE_OR_COPY(LOC_WIND_DIR_DEG, TRUE);
     comb->location->wind_dir_name =
-        g_strdup(wind_dir_name_by_deg(comb->location->wind_dir_deg, FALSE));
+        g_intern_string(wind_dir_name_by_deg(comb->location, FALSE));
 
-    INTERPOLATE_OR_COPY(wind_speed_mps, FALSE);
-    INTERPOLATE_OR_COPY(wind_speed_beaufort, FALSE);
-    INTERPOLATE_OR_COPY(humidity_value, FALSE);
-    COMB_END_COPY(humidity_unit);
+    INTERPOLATE_OR_COPY(LOC_WIND_SPEED_MPS, FALSE);
+    INTERPOLATE_OR_COPY(LOC_WIND_SPEED_BEAUFORT, FALSE);
+    INTERPOLATE_OR_COPY(LOC_HUMIDITY, FALSE);
+    comb->location->humidity_unit = end->location->humidity_unit;
 
-    INTERPOLATE_OR_COPY(pressure_value, FALSE);
-    COMB_END_COPY(pressure_unit);
+    INTERPOLATE_OR_COPY(LOC_PRESSURE, FALSE);
+    comb->location->pressure_unit = end->location->pressure_unit;
 
-    for (i = 0; i < CLOUDS_PERC_NUM; i++)
-        INTERPOLATE_OR_COPY(clouds_percent[i], FALSE);
-
-    INTERPOLATE_OR_COPY(fog_percent, FALSE);
+    INTERPOLATE_OR_COPY(LOC_CLOUDS_LOW, FALSE);
+    INTERPOLATE_OR_COPY(LOC_CLOUDS_MID, FALSE);
+    INTERPOLATE_OR_COPY(LOC_CLOUDS_HIGH, FALSE);
+    INTERPOLATE_OR_COPY(LOC_CLOUDINESS, FALSE);
+    INTERPOLATE_OR_COPY(LOC_FOG, FALSE);
 
     /* it makes no sense to interpolate the following (interval) values */
-    comb->location->precipitation_value =
-        g_strdup(interval->location->precipitation_value);
+    if (LOC_HAS(interval->location, LOC_PRECIPITATION))
+        LOC_SET(comb->location, LOC_PRECIPITATION,
+                interval->location->values[LOC_PRECIPITATION]);
     comb->location->precipitation_unit =
-        g_strdup(interval->location->precipitation_unit);
+        interval->location->precipitation_unit;
 
     comb->location->symbol_id = interval->location->symbol_id;
-    comb->location->symbol = g_strdup(interval->location->symbol);
+    comb->location->symbol = interval->location->symbol;
 
     calculate_symbol(comb, current_conditions);
     return comb;
@@ -806,8 +804,9 @@ merge_timeslice(xml_weather *wd,
                 const xml_time *timeslice)
 {
     xml_time *old_ts, *new_ts;
+    xml_location *loc;
+    profile_mark mark;
     time_t now_t = time(NULL);
-    guint index;
 
     g_assert(wd != NULL);
     if (G_UNLIKELY(wd == NULL))
@@ -819,21 +818,26 @@ merge_timeslice(xml_weather *wd,
         return;
     }
 
+    weather_profile_begin(&mark);
+
     /* Copy timeslice, as it will be deleted by the calling function */
     new_ts = xml_time_copy(timeslice);
 
     /* check if there is a timeslice with the same interval and
-       replace it with the current data */
-    old_ts = get_timeslice(wd, timeslice->start, timeslice->end, &index);
+       replace its data with the current data, keeping it in place */
+    old_ts = get_timeslice(wd, timeslice->start, timeslice->end);
     if (old_ts) {
-        xml_time_free(old_ts);
-        g_array_remove_index(wd->timeslices, index);
-        g_array_insert_val(wd->timeslices, index, new_ts);
-        weather_debug("Replaced existing timeslice at %d.", index);
+        loc = old_ts->location;
+        old_ts->location = new_ts->location;
+        new_ts->location = loc;
+        xml_time_free(new_ts);
+        xml_weather_invalidate(wd);
+        weather_debug("Replaced data of existing timeslice.");
     } else {
-        g_array_prepend_val(wd->timeslices, new_ts);
-        //weather_debug("Prepended timeslice to the existing timeslices.");
+        xml_weather_add_timeslice(wd, new_ts);
+        //weather_debug("Appended timeslice to the existing timeslices.");
     }
+    weather_profile_end(PROFILE_MERGE, &mark);
 }
 
 
@@ -968,48 +972,69 @@ xml_time_compare(gconstpointer a,
 }
 
 
-static void
-point_data_results_free(point_data_results *pdr)
+/* check whether there is point data for a point in time */
+static gboolean
+has_point_data(xml_weather *wd,
+               const time_t point_t)
 {
-    g_assert(pdr != NULL);
-    if (G_UNLIKELY(pdr == NULL))
-        return;
+    xml_time *timeslice;
 
-    g_assert(pdr->before != NULL);
-    g_array_free(pdr->before, FALSE);
-    g_assert(pdr->after != NULL);
-    g_array_free(pdr->after, FALSE);
-    g_slice_free(point_data_results, pdr);
-    return;
+    timeslice = get_timeslice(wd, point_t, point_t);
+    return (timeslice && !timeslice_is_interval(timeslice));
 }
 
+
 /*
- * Given an array of point data, find two points for which
- * corresponding interval data can be found so that the interval is as
- * small as possible, returning NULL if such interval data doesn't
- * exist.
+ * Find the smallest interval around point_t for which point data is
+ * available both at its start and its end, each between min_diff and
+ * max_diff seconds away from point_t. Intervals starting later are
+ * preferred, then those ending earlier. Returns NULL if such interval
+ * data doesn't exist.
  */
 static xml_time *
 find_smallest_interval(xml_weather *wd,
-                       const point_data_results *pdr)
+                       const time_t point_t,
+                       const gdouble min_diff,
+                       const gdouble max_diff)
 {
-    GArray *before = pdr->before, *after = pdr->after;
-    xml_time *ts_before, *ts_after, *found;
-    guint i, j;
+    const xml_time_columns *columns;
+    xml_time *found = NULL;
+    time_t start_t;
+    gdouble diff;
+    guint i, j, first;
 
-    if (before->len == 0)
-        return NULL;
+    columns = xml_weather_get_columns(wd);
 
-    for (i = before->len - 1; i > 0; i--) {
-        ts_before = g_array_index(before, xml_time *, i);
-        for (j = 0; j < after->len; j++) {
-            ts_after = g_array_index(after, xml_time *, j);
-            found = get_timeslice(wd, ts_before->start, ts_after->end, NULL);
-            if (found)
-                return found;
-        }
+    /* walk backwards over the groups of timeslices sharing the same
+       start time, beginning with the last one starting at least
+       min_diff before point_t */
+    i = xml_time_columns_search(columns, point_t - (time_t) min_diff + 1);
+    while (i > 0 && found == NULL) {
+        start_t = columns->start[i - 1];
+        if (difftime(point_t, start_t) > max_diff)
+            break;
+        first = xml_time_columns_search(columns, start_t);
+
+        /* within a group, timeslices are sorted by end time */
+        if (has_point_data(wd, start_t))
+            for (j = first; j < i; j++) {
+                if (!columns->interval[j])
+                    continue;
+                diff = difftime(columns->end[j], point_t);
+                if (diff < min_diff)
+                    continue;
+                if (diff > max_diff)
+                    break;
+                if (has_point_data(wd, columns->end[j])) {
+                    found = columns->timeslices[j];
+                    break;
+                }
+            }
+        i = first;
     }
-    return NULL;
+    weather_debug("Search result for smallest interval is:");
+    weather_dump(weather_dump_timeslice, found);
+    return found;
 }
 
 
@@ -1017,21 +1042,23 @@ static xml_time *
 find_smallest_incomplete_interval(xml_weather *wd,
                                   time_t end_t)
 {
+    const xml_time_columns *columns;
     xml_time *timeslice, *found = NULL;
     guint i;
 
     weather_debug("Searching for the smallest incomplete interval.");
-    /* search for all timeslices with interval data that have end time end_t */
-    for (i = 0; i < wd->timeslices->len; i++) {
-        timeslice = g_array_index(wd->timeslices, xml_time *, i);
-        if (timeslice && difftime(timeslice->end, end_t) == 0
-            && difftime(timeslice->end, timeslice->start) != 0) {
-            if (found == NULL)
-                found = timeslice;
-            else
-                if (difftime(timeslice->start, found->start) > 0)
-                    found = timeslice;
-            weather_dump(weather_dump_timeslice, found);
+    /* search for the timeslice with interval data that has end time
+       end_t and starts last, which is the last one of those ending
+       at end_t that is not point data */
+    columns = xml_weather_get_columns(wd);
+    i = xml_time_columns_search_end(columns, end_t + 1);
+    for (; i > 0; i--) {
+        timeslice = columns->by_end[i - 1];
+        if (timeslice->end != end_t)
+            break;
+        if (timeslice->start != end_t) {
+            found = timeslice;
+            break;
         }
     }
     weather_debug("Search result for smallest incomplete interval is:");
@@ -1040,77 +1067,20 @@ find_smallest_incomplete_interval(xml_weather *wd,
 }
 
 
-/* find point data within certain limits around a point in time */
-static point_data_results *
-find_point_data(const xml_weather *wd,
-                const time_t point_t,
-                const gdouble min_diff,
-                const gdouble max_diff)
-{
-    point_data_results *found;
-    xml_time *timeslice;
-    gdouble diff;
-    guint i;
-
-    found = g_slice_new0(point_data_results);
-    found->before = g_array_new(FALSE, TRUE, sizeof(xml_time *));
-    found->after = g_array_new(FALSE, TRUE, sizeof(xml_time *));
-
-    weather_debug("Checking %d timeslices for point data.",
-                  wd->timeslices->len);
-    for (i = 0; i < wd->timeslices->len; i++) {
-        timeslice = g_array_index(wd->timeslices, xml_time *, i);
-        /* look only for point data, not intervals */
-        if (G_UNLIKELY(timeslice == NULL) || timeslice_is_interval(timeslice))
-            continue;
-
-        /* add point data if within limits */
-        diff = difftime(timeslice->end, point_t);
-        if (diff <= 0) {  /* before point_t */
-            diff *= -1;
-            if (diff < min_diff || diff > max_diff)
-                continue;
-            g_array_append_val(found->before, timeslice);
-            weather_dump(weather_dump_timeslice, timeslice);
-        } else {          /* after point_t */
-            if (diff < min_diff || diff > max_diff)
-                continue;
-            g_array_append_val(found->after, timeslice);
-            weather_dump(weather_dump_timeslice, timeslice);
-        }
-    }
-    g_array_sort(found->before, (GCompareFunc) xml_time_compare);
-    g_array_sort(found->after, (GCompareFunc) xml_time_compare);
-    found->point = point_t;
-    weather_debug("Found %d timeslices with point data, "
-                  "%d before and %d after point_t.",
-                  (found->before->len + found->after->len),
-                  found->before->len, found->after->len);
-    return found;
-}
-
-
-xml_time *
-make_current_conditions(xml_weather *wd,
+static xml_time *
+calc_current_conditions(xml_weather *wd,
                         time_t now_t)
 {
-    point_data_results *found = NULL;
     xml_time *interval = NULL, *incomplete;
     struct tm point_tm = *localtime(&now_t);
     time_t point_t = now_t;
     gint i = 0;
 
-    g_assert(wd != NULL);
-    if (G_UNLIKELY(wd == NULL))
-        return NULL;
-
     /* there may not be a timeslice available for the current
        interval, so look max three hours ahead */
     while (i < 3 && interval == NULL) {
         point_t = time_calc_hour(point_tm, i);
-        found = find_point_data(wd, point_t, 1, 4 * 3600);
-        interval = find_smallest_interval(wd, found);
-        point_data_results_free(found);
+        interval = find_smallest_interval(wd, point_t, 1, 4 * 3600);
 
         /* There may be interval data where point data is only
            available at the end of that interval. If such an interval
@@ -1131,6 +1101,28 @@ make_current_conditions(xml_weather *wd,
 }
 
 
+/*
+ * Return current conditions for now_t, searching for and interpolating
+ * the timeslices around it. The caller owns the result.
+ */
+xml_time *
+make_current_conditions(xml_weather *wd,
+                        time_t now_t)
+{
+    xml_time *conditions;
+    profile_mark mark;
+
+    g_assert(wd != NULL);
+    if (G_UNLIKELY(wd == NULL))
+        return NULL;
+
+    weather_profile_begin(&mark);
+    conditions = calc_current_conditions(wd, now_t);
+    weather_profile_end(PROFILE_CONDITIONS, &mark);
+    return conditions;
+}
+
+
 /*
  * Add days to time_t and set the calculated day to midnight.
  */
@@ -1176,215 +1168,158 @@ get_astro_data_for_day(const GArray *astrodata,
 
 
 /*
- * Get all point data relevant for a given day.
+ * Find an interval of about DAYTIME_LEN hours between start_t and
+ * end_t that contains point_t and starts and ends with point data at
+ * 0, 6, 12 or 18 hours UTC time.
  */
-GArray *
-get_point_data_for_day(xml_weather *wd,
-                       gint day)
+static xml_time *
+find_daytime_interval(xml_weather *wd,
+                      const xml_time_columns *columns,
+                      const time_t start_t,
+                      const time_t end_t,
+                      const time_t point_t)
 {
-    GArray *found;
-    xml_time *timeslice;
-    time_t day_t = time(NULL);
-    guint i;
+    xml_time *interval;
+    time_t ts1, ts2;
+    gdouble diff;
+    guint i, j, first, last;
 
-    day_t = day_at_midnight(day_t, day);
+    /* only point data within the daytime limits is of interest */
+    first = xml_time_columns_search(columns, start_t);
+    last = xml_time_columns_search(columns, end_t + 1);
 
-    /* loop over weather data and pick relevant point data */
-    found = g_array_new(FALSE, TRUE, sizeof(xml_time *));
-    g_assert(found != NULL);
-    if (G_UNLIKELY(found == NULL))
-        return NULL;
+    for (i = first; i < last; i++) {
+        ts1 = columns->start[i];
+        if (columns->interval[i] || UTC_HOUR(ts1) % 6 != 0)
+            continue;
+
+        for (j = i + 1; j < last; j++) {
+            ts2 = columns->start[j];
+            if (columns->interval[j] || UTC_HOUR(ts2) % 6 != 0)
+                continue;
 
-    weather_debug("Checking %d timeslices for point data relevant to day %d.",
-                  wd->timeslices->len, day);
-    for (i = 0; i < wd->timeslices->len; i++) {
-        timeslice = g_array_index(wd->timeslices, xml_time *, i);
+            /* start and end timeslice need to be a 6 hours interval,
+               however we may need to take into account possible dst
+               difference so let's also try DAYTIME_LEN ±1 hour */
+            diff = difftime(ts2, ts1);
+            if (diff != DAYTIME_LEN * 3600 &&
+                (diff < (DAYTIME_LEN - 1) * 3600 ||
+                 diff > (DAYTIME_LEN + 1) * 3600) &&
+                get_timeslice(wd, ts1, columns->end[j]) == NULL)
+                continue;
 
-        /* look only for point data, not intervals */
-        if (G_UNLIKELY(timeslice == NULL) || timeslice_is_interval(timeslice))
-            continue;
+            /* daytime point needs to be within the interval */
+            if (difftime(point_t, ts1) < 0 || difftime(ts2, point_t) < 0)
+                continue;
 
-        if (difftime(timeslice->start, day_t) >= DAY_START * 3600 &&
-            difftime(timeslice->end, day_t) <= DAY_END * 3600) {
-            weather_dump(weather_dump_timeslice, timeslice);
-            g_array_append_val(found, timeslice);
+            /* check whether the desired interval exists */
+            interval = get_timeslice(wd, ts1, columns->end[j]);
+            if (interval)
+                return interval;
         }
     }
-    g_array_sort(found, (GCompareFunc) xml_time_compare);
-    weather_debug("Found %d timeslices for day %d.", found->len, day);
-    return found;
+    return NULL;
 }
 
 
 /*
- * Return forecast data for a given daytime, using the data provided.
+ * Return forecast data for all daytimes of the given number of days,
+ * starting today. Day boundaries are calculated only once per day,
+ * and the data is searched for in the sorted timeslice columns.
  */
-xml_time *
-make_forecast_data(xml_weather *wd,
-                   GArray *daydata,
-                   gint day,
-                   daytime dt)
+forecast_grid *
+make_forecast_grid(xml_weather *wd,
+                   const guint days)
 {
-    xml_time *ts1, *ts2, *interval = NULL;
-    struct tm point_tm, start_tm, end_tm, tm1, tm2;
-    time_t point_t, start_t, end_t;
-    gint min = 0, max = 0, point = 0;
-    guint i, j;
+    const xml_time_columns *columns;
+    forecast_grid *grid;
+    xml_time *interval, *cc;
+    profile_mark mark;
+    struct tm day_tm;
+    time_t now_t = time(NULL), hours_t[DAYTIMES + 2];
+    guint day, i;
+    daytime dt;
 
     g_assert(wd != NULL);
     if (G_UNLIKELY(wd == NULL))
         return NULL;
 
-    g_assert(daydata != NULL);
-    if (G_UNLIKELY(daydata == NULL))
-        return NULL;
-
-    /* choose search interval and desired point in time depending on daytime */
-    switch (dt) {
-    case MORNING:
-        min = 3;
-        max = 15;
-        point = 9;
-        break;
-    case AFTERNOON:
-        min = 9;
-        max = 21;
-        point = 15;
-        break;
-    case EVENING:
-        min = 15;
-        max = 27;
-        point = 21;
-        break;
-    case NIGHT:
-        min = 21;
-        max = 33;
-        point = 27;
-        break;
-    }
-
-    /* initialize times to the current day */
-    time(&point_t);
-    start_tm = end_tm = point_tm = *localtime(&point_t);
-
-    /* calculate daytime limits for the requested day */
-    point_tm.tm_mday += day;
-    point_tm.tm_hour = point;
-    point_tm.tm_min = point_tm.tm_sec = 0;
-    point_tm.tm_isdst = -1;
-    point_t = mktime(&point_tm);
-
-    start_tm.tm_mday += day;
-    start_tm.tm_hour = min;
-    start_tm.tm_min = start_tm.tm_sec = 0;
-    start_tm.tm_isdst = -1;
-    start_t = mktime(&start_tm);
-
-    end_tm.tm_mday += day;
-    end_tm.tm_hour = max;
-    end_tm.tm_min = end_tm.tm_sec = 0;
-    end_tm.tm_isdst = -1;
-    end_t = mktime(&end_tm);
-
-    /* using search criteria, find an appropriate interval */
-    for (i = 0; i < daydata->len; i++) {
-        weather_debug("checking start ts %d", i);
-
-        /* try start timeslice for interval */
-        ts1 = g_array_index(daydata, xml_time *, i);
-
-        if (G_UNLIKELY(ts1 == NULL))
-            continue;
-        weather_debug("start ts is not null");
+    weather_profile_begin(&mark);
+    grid = g_slice_new0(forecast_grid);
+    grid->days = days;
+    grid->cells = g_new0(xml_time *, days * DAYTIMES);
 
-        /* start timeslice needs to be within max daytime interval */
-        if (difftime(ts1->start, start_t) < 0 ||
-            difftime(end_t, ts1->start) < 0)
-            continue;
-        weather_debug("start ts is in max daytime interval");
-
-        /* start timeslice needs to start at 0, 6, 12, or 18 hours UTC time */
-        tm1 = *gmtime(&ts1->start);
-        if (tm1.tm_hour != 0 && tm1.tm_hour % 6 != 0)
-            continue;
-        weather_debug("start ts does start at 0, 6, 12, 18 hour UTC time");
-
-        for (j = 0; j < daydata->len; j++) {
-            weather_debug("checking end ts %d", j);
-
-            /* find end timeslice for interval */
-            ts2 = g_array_index(daydata, xml_time *, j);
-
-            if (G_UNLIKELY(ts2 == NULL))
-                continue;
-            weather_debug("end ts is not null");
-
-            /* end timeslice has to be different from the start timeslice */
-            if (ts1 == ts2)
-                continue;
-            weather_debug("start ts is different from end ts");
+    columns = xml_weather_get_columns(wd);
+    cc = wd->current_conditions;
+    day_tm = *localtime(&now_t);
+    day_tm.tm_hour = day_tm.tm_min = day_tm.tm_sec = 0;
 
-            /* end timeslice needs to be after start timeslice */
-            if (difftime(ts2->start, ts1->start) <= 0)
+    for (day = 0; day < days; day++) {
+        /* each daytime starts at one of these hours, has its point
+           at the next and ends at the one after that */
+        for (i = 0; i < G_N_ELEMENTS(hours_t); i++)
+            hours_t[i] = time_calc(day_tm, 0, 0, day,
+                                   DAY_START + i * DAYTIME_LEN, 0, 0);
+
+        for (dt = MORNING; dt <= NIGHT; dt++) {
+            interval = find_daytime_interval(wd, columns, hours_t[dt],
+                                             hours_t[dt + 2],
+                                             hours_t[dt + 1]);
+            if (interval) {
+                grid->cells[day * DAYTIMES + dt] =
+                    make_combined_timeslice(wd, interval,
+                                            &hours_t[dt + 1], FALSE);
                 continue;
-            weather_debug("start ts is before end ts");
-
-            /* end timeslice needs to be in max daytime interval */
-            if (difftime(ts2->start, start_t) < 0 ||
-                difftime(end_t, ts2->start) < 0)
+            }
+
+            /* Finding a 6 hours daytime interval failed; maybe
+               current time is within this interval and therefore
+               that 6 hours interval is not available anymore. In
+               that case, simply trying the current conditions
+               interval is better than nothing. */
+            if (cc &&
+                difftime(cc->start, hours_t[dt]) >= 0 &&
+                difftime(hours_t[dt + 2], cc->end) >= 0) {
+                interval = get_timeslice(wd, cc->start, cc->end);
+                if (interval)
+                    grid->cells[day * DAYTIMES + dt] =
+                        make_combined_timeslice(wd, interval,
+                                                &cc->point, FALSE);
+                weather_debug("using current conditions interval for "
+                              "daytime %d of day %d", dt, day);
                 continue;
-            weather_debug("end ts is in max daytime interval");
+            }
+            weather_debug("no forecast data for daytime %d of day %d",
+                          dt, day);
+        }
+    }
+    weather_profile_end(PROFILE_FORECAST, &mark);
+    return grid;
+}
 
-            /* end timeslice needs to start at 0, 6, 12, or 18 hours UTC time */
-            tm2 = *gmtime(&ts2->start);
-            if (tm2.tm_hour != 0 && tm2.tm_hour % 6 != 0)
-                continue;
-            weather_debug("end ts does start at 0, 6, 12, 18 hour UTC time");
-
-            /* start and end timeslice need to be a 6 hours interval... */
-            if (difftime(ts2->start, ts1->start) != DAYTIME_LEN * 3600)
-                /* ...however we may need to take into account possible dst
-                   difference so let's also try DAYTIME_LEN ±1 hour */
-                if ((difftime(ts2->start, ts1->start) < (DAYTIME_LEN - 1) * 3600 ||
-                     difftime(ts2->start, ts1->start) > (DAYTIME_LEN + 1) * 3600) &&
-                    get_timeslice(wd, ts1->start, ts2->end, NULL) == NULL)
-                    continue;
-            weather_debug("start and end ts are 6 hours apart");
 
-            /* daytime point needs to be within the interval */
-            if (difftime(point_t, ts1->start) < 0 ||
-                difftime(ts2->start, point_t) < 0)
-                continue;
-            weather_debug("daytime point is within the found interval");
+/* Return forecast data of a grid cell, or NULL if not available. */
+const xml_time *
+forecast_grid_get(const forecast_grid *grid,
+                  const guint day,
+                  const daytime dt)
+{
+    if (G_UNLIKELY(grid == NULL || day >= grid->days))
+        return NULL;
+    return grid->cells[day * DAYTIMES + dt];
+}
 
-            /* check whether the desired interval exists */
-            interval = get_timeslice(wd, ts1->start, ts2->end, NULL);
-            if (interval == NULL)
-                continue;
 
-            /* make and return a combined interval with interpolated data */
-            weather_debug("returning valid interval");
-            return make_combined_timeslice(wd, interval, &point_t, FALSE);
-        }
-    }
-
-    /* Finding a 6 hours daytime interval failed; maybe current time
-       is within this interval and therefore that 6 hours interval is
-       not available anymore. In that case, simply trying the current
-       conditions interval is better than nothing. */
-    if (wd->current_conditions &&
-        difftime(wd->current_conditions->start, start_t) >= 0 &&
-        difftime(end_t, wd->current_conditions->end) >= 0) {
-        interval = get_timeslice(wd, wd->current_conditions->start,
-                                 wd->current_conditions->end, NULL);
-        weather_debug("returning current conditions interval for daytime %d "
-                      "of day %d", dt, day);
-        return make_combined_timeslice(wd, interval,
-                                       &wd->current_conditions->point, FALSE);
-    }
+void
+forecast_grid_free(forecast_grid *grid)
+{
+    guint i;
 
-    /* If we got as far as this, it's very unlikely we find a smaller
-       interval, so just give up. */
-    weather_debug("no forecast data for daytime %d of day %d", dt, day);
-    return NULL;
+    if (G_UNLIKELY(grid == NULL))
+        return;
+    for (i = 0; i < grid->days * DAYTIMES; i++)
+        if (grid->cells[i])
+            xml_time_free(grid->cells[i]);
+    g_free(grid->cells);
+    g_slice_free(forecast_grid, grid);
 }
@@ -87,6 +87,11 @@ typedef enum {
     NIGHT
 } daytime;
 
+typedef struct {
+    guint days;
+    xml_time **cells;
+} forecast_grid;
+
 typedef struct {
     gint temperature;
     gint apparent_temperature;
@@ -159,13 +164,14 @@ time_t day_at_midnight(time_t day_t,
 xml_astro *get_astro_data_for_day(const GArray *astrodata,
                                   const gint day);
 
-GArray *get_point_data_for_day(xml_weather *wd,
-                               const gint day);
+forecast_grid *make_forecast_grid(xml_weather *wd,
+                                  const guint days);
+
+const xml_time *forecast_grid_get(const forecast_grid *grid,
+                                  const guint day,
+                                  const daytime dt);
 
-xml_time *make_forecast_data(xml_weather *wd,
-                             GArray *daydata,
-                             gint day,
-                             daytime dt);
+void forecast_grid_free(forecast_grid *grid);
 
 G_END_DECLS
 
@@ -31,6 +31,25 @@
 
 #define YESNO(bool) ((bool) ? "yes" : "no")
 
+typedef struct {
+    guint64 ops;
+    gint64 time;                /* microseconds */
+    guint64 allocs;
+} profile_stats;
+
+static const gchar *profile_stage_names[PROFILE_STAGES] = {
+    "parse chunk",
+    "merge timeslice",
+    "clean weather data",
+    "current conditions",
+    "forecast grid",
+    "read cache file"
+};
+
+/* only used from the main thread */
+static profile_stats profile[PROFILE_STAGES];
+static guint64 profile_allocs = 0;
+
 
 #if GLIB_CHECK_VERSION(2,32,0)
 #else
@@ -110,6 +129,82 @@ weather_debug_real(const gchar *log_domain,
 }
 
 
+/*
+ * Profiling of the data pipeline. Stages are measured between
+ * weather_profile_begin() and weather_profile_end(), counting time
+ * and timeslice allocations, but only in debug mode.
+ */
+void
+weather_profile_begin(profile_mark *mark)
+{
+    if (G_LIKELY(!debug_mode))
+        return;
+    mark->time = g_get_monotonic_time();
+    mark->allocs = profile_allocs;
+}
+
+
+void
+weather_profile_end(profile_stage stage,
+                    const profile_mark *mark)
+{
+    if (G_LIKELY(!debug_mode))
+        return;
+    profile[stage].ops++;
+    profile[stage].time += g_get_monotonic_time() - mark->time;
+    profile[stage].allocs += profile_allocs - mark->allocs;
+}
+
+
+void
+weather_profile_alloc(guint n)
+{
+    if (G_UNLIKELY(debug_mode))
+        profile_allocs += n;
+}
+
+
+/* timeslice allocations counted so far, for benchmarks */
+guint64
+weather_profile_get_allocs(void)
+{
+    return profile_allocs;
+}
+
+
+gchar *
+weather_dump_profile(void)
+{
+    GString *out;
+    gchar *result;
+    guint i;
+
+    out = g_string_sized_new(512);
+    g_string_assign(out, "Profile:\n");
+    g_string_append_printf(out, "  %-20s %10s %12s %12s\n",
+                           "stage", "ops", "ns/op", "timeslices/op");
+    g_string_append(out,
+                    "  --------------------------------------------"
+                    "--------------\n");
+    for (i = 0; i < PROFILE_STAGES; i++) {
+        if (profile[i].ops == 0)
+            continue;
+        g_string_append_printf(out, "  %-20s %10" G_GUINT64_FORMAT
+                               " %12.0f %12.1f\n",
+                               profile_stage_names[i], profile[i].ops,
+                               profile[i].time * 1000.0 / profile[i].ops,
+                               (gdouble) profile[i].allocs / profile[i].ops);
+    }
+    g_string_append_printf(out, "  timeslice allocations: %" G_GUINT64_FORMAT,
+                           profile_allocs);
+
+    /* Free GString only and return its character data */
+    result = out->str;
+    g_string_free(out, FALSE);
+    return result;
+}
+
+
 gchar *
 weather_dump_geolocation(const xml_geolocation *geo)
 {
@@ -194,12 +289,20 @@ weather_dump_icon_theme(const icon_theme *theme)
                           "  Author: %s\n"
                           "  Description: %s\n"
                           "  License: %s\n"
+                          "  Cached icons: %u\n"
+                          "  Icon atlases: %u\n"
+                          "  Icon cache hits: %u\n"
+                          "  Icon cache misses: %u\n"
                           "  --------------------------------------------",
                           theme->dir,
                           theme->name,
                           theme->author,
                           theme->description,
-                          theme->license);
+                          theme->license,
+                          theme->cache->lru->length,
+                          g_hash_table_size(theme->cache->atlases),
+                          theme->cache->hits,
+                          theme->cache->misses);
     return out;
 }
 
@@ -275,41 +378,45 @@ weather_dump_location(const xml_location *loc,
     if (!loc)
         return g_strdup("No location data.");
 
+#define V(value) (loc->values[LOC_##value])
     if (interval)
         out =
-            g_strdup_printf("alt=%s, lat=%s, lon=%s, "
-                            "prec=%s %s, symid=%d (%s)",
-                            loc->altitude,
-                            loc->latitude,
-                            loc->longitude,
-                            loc->precipitation_value,
+            g_strdup_printf("alt=%.0f, lat=%.4f, lon=%.4f, "
+                            "prec=%.1f %s, symid=%d (%s)",
+                            V(ALTITUDE),
+                            V(LATITUDE),
+                            V(LONGITUDE),
+                            V(PRECIPITATION),
                             loc->precipitation_unit,
                             loc->symbol_id,
                             loc->symbol);
     else
         out =
-            g_strdup_printf("alt=%s, lat=%s, lon=%s, temp=%s %s, "
-                            "wind=%s %s° %s m/s (%s bf), "
-                            "hum=%s %s, press=%s %s, fog=%s, cloudiness=%s, "
-                            "cl=%s, cm=%s, ch=%s)",
-                            loc->altitude,
-                            loc->latitude,
-                            loc->longitude,
-                            loc->temperature_value,
+            g_strdup_printf("alt=%.0f, lat=%.4f, lon=%.4f, temp=%.1f %s, "
+                            "wind=%s %.1f° %.1f m/s (%.0f bf), "
+                            "hum=%.1f %s, press=%.1f %s, fog=%.1f, "
+                            "cloudiness=%.1f, cl=%.1f, cm=%.1f, ch=%.1f), "
+                            "valid=0x%04x",
+                            V(ALTITUDE),
+                            V(LATITUDE),
+                            V(LONGITUDE),
+                            V(TEMPERATURE),
                             loc->temperature_unit,
                             loc->wind_dir_name,
-                            loc->wind_dir_deg,
-                            loc->wind_speed_mps,
-                            loc->wind_speed_beaufort,
-                            loc->humidity_value,
+                            V(WIND_DIR_DEG),
+                            V(WIND_SPEED_MPS),
+                            V(WIND_SPEED_BEAUFORT),
+                            V(HUMIDITY),
                             loc->humidity_unit,
-                            loc->pressure_value,
+                            V(PRESSURE),
                             loc->pressure_unit,
-                            loc->fog_percent,
-                            loc->clouds_percent[CLOUDS_PERC_CLOUDINESS],
-                            loc->clouds_percent[CLOUDS_PERC_LOW],
-                            loc->clouds_percent[CLOUDS_PERC_MID],
-                            loc->clouds_percent[CLOUDS_PERC_HIGH]);
+                            V(FOG),
+                            V(CLOUDINESS),
+                            V(CLOUDS_LOW),
+                            V(CLOUDS_MID),
+                            V(CLOUDS_HIGH),
+                            loc->valid);
+#undef V
     return out;
 }
 
@@ -410,7 +517,7 @@ weather_dump_plugindata(const plugin_data *data)
     GString *out;
     gchar *last_astro_update, *last_weather_update, *last_conditions_update;
     gchar *next_astro_update, *next_weather_update, *next_conditions_update;
-    gchar *next_wakeup, *result;
+    gchar *next_wakeup, *profile_text, *result;
 
     last_astro_update = format_date(data->astro_update->last, "%c", TRUE);
     last_weather_update = format_date(data->weather_update->last, "%c", TRUE);
@@ -446,6 +553,7 @@ weather_dump_plugindata(const plugin_data *data)
                            "  next conditions update: %s\n"
                            "  next scheduled wakeup: %s\n"
                            "  wakeup reason: %s\n"
+                           "  wakeups: %u\n"
                            "  --------------------------------------------\n"
                            "  geonames username set by user: %s\n"
                            "  --------------------------------------------\n"
@@ -459,6 +567,7 @@ weather_dump_plugindata(const plugin_data *data)
                            "  --------------------------------------------\n"
                            "  icon theme dir: %s\n"
                            "  tooltip style: %d\n"
+                           "  tooltip generation: %u (built: %u)\n"
                            "  forecast layout: %d\n"
                            "  forecast days: %d\n"
                            "  round values: %s\n"
@@ -469,6 +578,10 @@ weather_dump_plugindata(const plugin_data *data)
                            "  scrollbox color: %s\n"
                            "  scrollbox use color: %s\n"
                            "  animate scrollbox: %s\n"
+                           "  scrollbox animation duration: %u ms\n"
+                           "  scrollbox max fps: %u\n"
+                           "  scrollbox frames skipped for max fps: %u\n"
+                           "  scrollbox frames saved while paused (estimate): %u\n"
                            "  --------------------------------------------",
                            data->panel_size,
                            data->panel_rows,
@@ -488,6 +601,7 @@ weather_dump_plugindata(const plugin_data *data)
                            next_conditions_update,
                            next_wakeup,
                            data->next_wakeup_reason,
+                           data->wakeups,
                            YESNO(data->geonames_username),
                            data->location_name,
                            data->lat,
@@ -498,6 +612,8 @@ weather_dump_plugindata(const plugin_data *data)
                            YESNO(data->night_time),
                            (data->icon_theme) ? (data->icon_theme->dir) : NULL,
                            data->tooltip_style,
+                           data->tooltip_generation,
+                           data->tooltip_built,
                            data->forecast_layout,
                            data->forecast_days,
                            YESNO(data->round),
@@ -506,7 +622,11 @@ weather_dump_plugindata(const plugin_data *data)
                            data->scrollbox_font,
                            gdk_rgba_to_string(&(data->scrollbox_color)),
                            YESNO(data->scrollbox_use_color),
-                           YESNO(data->scrollbox_animate));
+                           YESNO(data->scrollbox_animate),
+                           data->scrollbox_duration,
+                           data->scrollbox_max_fps,
+                           data->scrollbox_skipped_frames,
+                           data->scrollbox_paused_frames);
     g_free(next_wakeup);
     g_free(next_astro_update);
     g_free(next_weather_update);
@@ -515,6 +635,10 @@ weather_dump_plugindata(const plugin_data *data)
     g_free(last_weather_update);
     g_free(last_conditions_update);
 
+    profile_text = weather_dump_profile();
+    g_string_append_printf(out, "\n%s", profile_text);
+    g_free(profile_text);
+
     /* Free GString only and return its character data */
     result = out->str;
     g_string_free(out, FALSE);
@@ -41,6 +41,22 @@ G_BEGIN_DECLS
     weather_debug_real(G_LOG_DOMAIN, __FILE__, __func__,    \
                        __LINE__, __VA_ARGS__)
 
+/* stages of the data pipeline measured in debug mode */
+typedef enum {
+    PROFILE_PARSE,
+    PROFILE_MERGE,
+    PROFILE_CLEAN,
+    PROFILE_CONDITIONS,
+    PROFILE_FORECAST,
+    PROFILE_CACHE_READ,
+    PROFILE_STAGES
+} profile_stage;
+
+typedef struct {
+    gint64 time;
+    guint64 allocs;
+} profile_mark;
+
 #define weather_dump(func, data)                \
     if (G_UNLIKELY(debug_mode)) {               \
         gchar *dump_msg = func(data);                \
@@ -58,6 +74,17 @@ void weather_debug_real(const gchar *log_domain,
                         const gchar *format,
                         ...);
 
+void weather_profile_begin(profile_mark *mark);
+
+void weather_profile_end(profile_stage stage,
+                         const profile_mark *mark);
+
+void weather_profile_alloc(guint n);
+
+guint64 weather_profile_get_allocs(void);
+
+gchar *weather_dump_profile(void);
+
 gchar *weather_dump_geolocation(const xml_geolocation *geo);
 
 gchar *weather_dump_place(const xml_place *place);
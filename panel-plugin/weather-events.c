@@ -0,0 +1,368 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Watches for the system events that make a scheduled wakeup time
+ * wrong or pointless: the wall clock being set, the system resuming
+ * from suspend, and the network coming back. This allows the update
+ * handler to sleep until its next real deadline instead of polling.
+ * The screensaver state is watched too, so that animations can be
+ * suspended while the screen is blanked or locked.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <gio/gio.h>
+#include <glib-unix.h>
+
+#ifdef HAVE_SYS_TIMERFD_H
+#include <sys/timerfd.h>
+#endif
+
+#include "weather-events.h"
+#include "weather-debug.h"
+
+#if defined(HAVE_SYS_TIMERFD_H) && defined(TFD_TIMER_CANCEL_ON_SET)
+#define HAVE_CLOCK_TIMER 1
+#define CLOCK_TIMER_YEARS 100
+#endif
+
+#define LOGIND_NAME "org.freedesktop.login1"
+#define LOGIND_PATH "/org/freedesktop/login1"
+#define LOGIND_MANAGER_INTERFACE "org.freedesktop.login1.Manager"
+#define SCREENSAVER_INTERFACE "org.freedesktop.ScreenSaver"
+
+
+struct _weather_events {
+    WeatherEventFunc func;
+    gpointer user_data;
+
+    /* wall clock changes */
+    gint clock_fd;
+    guint clock_source;
+
+    /* suspend/resume */
+    GCancellable *cancellable;
+    GDBusConnection *bus;
+    guint sleep_subscription;
+
+    /* screensaver */
+    GDBusConnection *session_bus;
+    guint screensaver_subscription;
+
+    /* connectivity */
+    GNetworkMonitor *monitor;
+    gulong monitor_handler;
+    gboolean network_available;
+};
+
+
+#ifdef HAVE_CLOCK_TIMER
+/*
+ * Arm the timer with an absolute expiry time that will practically
+ * never be reached. It only exists to get cancelled by the kernel as
+ * soon as someone sets the realtime clock. The expiry is relative to
+ * now, so that it is never in the past, which would make the timer
+ * fire and get re-armed over and over again.
+ */
+static gboolean
+clock_timer_arm(gint fd)
+{
+    struct itimerspec spec;
+    struct timespec now;
+    const gint64 far = (gint64) CLOCK_TIMER_YEARS * 365 * 24 * 3600;
+    gint64 expiry;
+
+    if (clock_gettime(CLOCK_REALTIME, &now) < 0) {
+        weather_debug("Could not get the current time: %s",
+                      g_strerror(errno));
+        return FALSE;
+    }
+
+    /* computed in 64 bits and clamped, as a 32-bit time_t cannot
+       hold 100 years in seconds */
+    expiry = (gint64) now.tv_sec + far;
+    if (sizeof(time_t) == 4 && expiry > G_MAXINT32)
+        expiry = G_MAXINT32;
+
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t) expiry;
+    if (timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET,
+                        &spec, NULL) < 0) {
+        weather_debug("Could not arm clock change timer: %s",
+                      g_strerror(errno));
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+static gboolean
+cb_clock_timer(gint fd,
+               GIOCondition condition,
+               gpointer user_data)
+{
+    weather_events *events = user_data;
+    guint64 expirations;
+
+    if (read(fd, &expirations, sizeof(expirations)) < 0 &&
+        errno == ECANCELED) {
+        weather_debug("System clock has been changed.");
+        events->func(WEATHER_EVENT_CLOCK_CHANGED, events->user_data);
+    }
+
+    /* cancellation disarms the timer, so it needs to be set again */
+    if (G_UNLIKELY(!clock_timer_arm(fd))) {
+        events->clock_source = 0;
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+
+static void
+clock_timer_init(weather_events *events)
+{
+    events->clock_fd = timerfd_create(CLOCK_REALTIME,
+                                      TFD_NONBLOCK | TFD_CLOEXEC);
+    if (events->clock_fd < 0) {
+        weather_debug("Could not create clock change timer: %s",
+                      g_strerror(errno));
+        return;
+    }
+    if (!clock_timer_arm(events->clock_fd)) {
+        close(events->clock_fd);
+        events->clock_fd = -1;
+        return;
+    }
+    events->clock_source = g_unix_fd_add(events->clock_fd, G_IO_IN,
+                                         cb_clock_timer, events);
+}
+#endif /* HAVE_CLOCK_TIMER */
+
+
+static void
+cb_prepare_for_sleep(GDBusConnection *connection,
+                     const gchar *sender_name,
+                     const gchar *object_path,
+                     const gchar *interface_name,
+                     const gchar *signal_name,
+                     GVariant *parameters,
+                     gpointer user_data)
+{
+    weather_events *events = user_data;
+    gboolean sleeping;
+
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(b)")))
+        return;
+
+    g_variant_get(parameters, "(b)", &sleeping);
+    weather_debug("Received PrepareForSleep(%s).",
+                  sleeping ? "true" : "false");
+    if (!sleeping)
+        events->func(WEATHER_EVENT_RESUMED, events->user_data);
+}
+
+
+static void
+cb_bus_get(GObject *source,
+           GAsyncResult *result,
+           gpointer user_data)
+{
+    weather_events *events;
+    GDBusConnection *bus;
+    GError *error = NULL;
+
+    bus = g_bus_get_finish(result, &error);
+    if (bus == NULL) {
+        /* when cancelled, events has already been freed */
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            weather_debug("Could not connect to the system bus, "
+                          "resume events will not be noticed: %s",
+                          error->message);
+        g_error_free(error);
+        return;
+    }
+
+    events = user_data;
+    events->bus = bus;
+    events->sleep_subscription =
+        g_dbus_connection_signal_subscribe(bus,
+                                           LOGIND_NAME,
+                                           LOGIND_MANAGER_INTERFACE,
+                                           "PrepareForSleep",
+                                           LOGIND_PATH,
+                                           NULL,
+                                           G_DBUS_SIGNAL_FLAGS_NONE,
+                                           cb_prepare_for_sleep,
+                                           events, NULL);
+}
+
+
+static void
+cb_screensaver_active_changed(GDBusConnection *connection,
+                              const gchar *sender_name,
+                              const gchar *object_path,
+                              const gchar *interface_name,
+                              const gchar *signal_name,
+                              GVariant *parameters,
+                              gpointer user_data)
+{
+    weather_events *events = user_data;
+    gboolean active;
+
+    if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(b)")))
+        return;
+
+    g_variant_get(parameters, "(b)", &active);
+    weather_debug("Received ActiveChanged(%s) from screensaver.",
+                  active ? "true" : "false");
+    events->func(active
+                 ? WEATHER_EVENT_SCREENSAVER_ACTIVE
+                 : WEATHER_EVENT_SCREENSAVER_INACTIVE,
+                 events->user_data);
+}
+
+
+static void
+cb_session_bus_get(GObject *source,
+                   GAsyncResult *result,
+                   gpointer user_data)
+{
+    weather_events *events;
+    GDBusConnection *bus;
+    GError *error = NULL;
+
+    bus = g_bus_get_finish(result, &error);
+    if (bus == NULL) {
+        /* when cancelled, events has already been freed */
+        if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            weather_debug("Could not connect to the session bus, "
+                          "screensaver will not be noticed: %s",
+                          error->message);
+        g_error_free(error);
+        return;
+    }
+
+    /* xfce4-screensaver and others emit this on differing paths */
+    events = user_data;
+    events->session_bus = bus;
+    events->screensaver_subscription =
+        g_dbus_connection_signal_subscribe(bus,
+                                           NULL,
+                                           SCREENSAVER_INTERFACE,
+                                           "ActiveChanged",
+                                           NULL,
+                                           NULL,
+                                           G_DBUS_SIGNAL_FLAGS_NONE,
+                                           cb_screensaver_active_changed,
+                                           events, NULL);
+}
+
+
+static void
+cb_network_changed(GNetworkMonitor *monitor,
+                   gboolean available,
+                   gpointer user_data)
+{
+    weather_events *events = user_data;
+    gboolean was_available = events->network_available;
+
+    /* the signal is emitted for every routing change, only the
+       transition to being connected is of interest */
+    events->network_available = available;
+    if (available && !was_available) {
+        weather_debug("Network has become available.");
+        events->func(WEATHER_EVENT_NETWORK_AVAILABLE, events->user_data);
+    }
+}
+
+
+weather_events *
+weather_events_new(WeatherEventFunc func,
+                   gpointer user_data)
+{
+    weather_events *events;
+
+    g_assert(func != NULL);
+    if (G_UNLIKELY(func == NULL))
+        return NULL;
+
+    events = g_slice_new0(weather_events);
+    events->func = func;
+    events->user_data = user_data;
+    events->clock_fd = -1;
+
+#ifdef HAVE_CLOCK_TIMER
+    clock_timer_init(events);
+#else
+    weather_debug("Clock change timer not supported on this system.");
+#endif
+
+    events->cancellable = g_cancellable_new();
+    g_bus_get(G_BUS_TYPE_SYSTEM, events->cancellable, cb_bus_get, events);
+    g_bus_get(G_BUS_TYPE_SESSION, events->cancellable,
+              cb_session_bus_get, events);
+
+    events->monitor = g_object_ref(g_network_monitor_get_default());
+    events->network_available =
+        g_network_monitor_get_network_available(events->monitor);
+    events->monitor_handler =
+        g_signal_connect(events->monitor, "network-changed",
+                         G_CALLBACK(cb_network_changed), events);
+    return events;
+}
+
+
+void
+weather_events_free(weather_events *events)
+{
+    if (G_UNLIKELY(events == NULL))
+        return;
+
+    if (events->clock_source)
+        g_source_remove(events->clock_source);
+    if (events->clock_fd >= 0)
+        close(events->clock_fd);
+
+    g_cancellable_cancel(events->cancellable);
+    g_object_unref(events->cancellable);
+    if (events->bus) {
+        if (events->sleep_subscription)
+            g_dbus_connection_signal_unsubscribe(events->bus,
+                                                 events->sleep_subscription);
+        g_object_unref(events->bus);
+    }
+    if (events->session_bus) {
+        if (events->screensaver_subscription)
+            g_dbus_connection_signal_unsubscribe
+                (events->session_bus, events->screensaver_subscription);
+        g_object_unref(events->session_bus);
+    }
+
+    g_signal_handler_disconnect(events->monitor, events->monitor_handler);
+    g_object_unref(events->monitor);
+
+    g_slice_free(weather_events, events);
+}
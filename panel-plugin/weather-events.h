@@ -0,0 +1,49 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __WEATHER_EVENTS_H__
+#define __WEATHER_EVENTS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+typedef struct _weather_events weather_events;
+
+/* system events that invalidate the scheduled wakeup time, or make
+   animations pointless while nobody is watching */
+typedef enum {
+    WEATHER_EVENT_CLOCK_CHANGED,
+    WEATHER_EVENT_RESUMED,
+    WEATHER_EVENT_NETWORK_AVAILABLE,
+    WEATHER_EVENT_SCREENSAVER_ACTIVE,
+    WEATHER_EVENT_SCREENSAVER_INACTIVE
+} weather_event;
+
+typedef void (*WeatherEventFunc) (weather_event event,
+                                  gpointer user_data);
+
+
+weather_events *weather_events_new(WeatherEventFunc func,
+                                   gpointer user_data);
+
+void weather_events_free(weather_events *events);
+
+G_END_DECLS
+
+#endif
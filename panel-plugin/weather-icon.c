@@ -21,6 +21,7 @@
 #endif
 
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gtk/gtk.h>
 #include <string.h>
 
@@ -34,6 +35,11 @@
 #define ICON_DIR_SMALL "22"
 #define ICON_DIR_MEDIUM "48"
 #define ICON_DIR_BIG "128"
+#define ICON_CACHE_SIZE 64
+#define ICON_ATLAS_CELLS (SYMBOL_COUNT * 2)
+#define ICON_ATLAS_FILES_MAX 8           /* saved atlases per theme */
+#define ICON_ATLAS_MAX_AGE (30 * 24 * 3600) /* of unused saved atlases */
+#define ICON_ATLAS_DELAY 2               /* seconds a size must stay used */
 
 
 static const gchar *symbol_names[] = {
@@ -70,61 +76,163 @@ const gchar *get_symbol_name(gint idx)
 }
 
 
+static const gchar *icon_sizedirs[] = {
+    ICON_DIR_SMALL,
+    ICON_DIR_MEDIUM,
+    ICON_DIR_BIG
+};
+
+
+static gpointer
+make_symbol_index(gpointer user_data)
+{
+    GHashTable *index;
+    gint i;
+
+    /* indices are stored plus one, so that they are never NULL */
+    index = g_hash_table_new(g_str_hash, g_str_equal);
+    for (i = 0; i < SYMBOL_COUNT; i++)
+        if (!g_hash_table_contains(index, symbol_names[i]))
+            g_hash_table_insert(index, (gpointer) symbol_names[i],
+                                GINT_TO_POINTER(i + 1));
+    return index;
+}
+
+
+/*
+ * Return the index of a symbol name in symbol_names, or -1 for names
+ * not found there. Polar symbols share the icons of their normal
+ * counterparts, so the first match is good enough. Icon lookups
+ * resolve the index once and pass it on.
+ */
+static gint
+get_symbol_index(const gchar *symbol_name)
+{
+    static GOnce index_once = G_ONCE_INIT;
+
+    g_once(&index_once, make_symbol_index, NULL);
+    return GPOINTER_TO_INT(g_hash_table_lookup(index_once.retval,
+                                               symbol_name)) - 1;
+}
+
+
+/*
+ * Each symbol has a bit per size directory and time of day, which is
+ * set when the icon has been verified to be missing in the theme.
+ */
+static guint8
+icon_missing_bit(const guint sizedir,
+                 const gboolean night)
+{
+    return 1 << (sizedir * 2 + (night ? 1 : 0));
+}
+
+
 static gboolean
 icon_missing(const icon_theme *theme,
-             const gchar *sizedir,
-             const gchar *symbol_name,
-             const gchar *suffix)
+             const guint sizedir,
+             const gint idx,
+             const gboolean night)
 {
-    gchar *missing, *icon;
-    guint i;
-
-    icon = g_strconcat(sizedir, G_DIR_SEPARATOR_S, symbol_name, suffix, NULL);
-    for (i = 0; i < theme->missing_icons->len; i++) {
-        missing = g_array_index(theme->missing_icons, gchar *, i);
-        if (G_UNLIKELY(missing == NULL))
-            continue;
-        if (!strcmp(missing, icon)) {
-            g_free(icon);
-            return TRUE;
-        }
-    }
-    g_free(icon);
-    return FALSE;
+    if (G_UNLIKELY(idx < 0))
+        return FALSE;
+    return (theme->missing_icons[idx] & icon_missing_bit(sizedir, night)) != 0;
 }
 
 
 static void
 remember_missing_icon(const icon_theme *theme,
-                      const gchar *sizedir,
-                      const gchar *symbol_name,
-                      const gchar *suffix)
+                      const guint sizedir,
+                      const gint idx,
+                      const gboolean night)
 {
-    gchar *icon;
-
-    icon = g_strconcat(sizedir, G_DIR_SEPARATOR_S, symbol_name, suffix, NULL);
-    g_array_append_val(theme->missing_icons, icon);
-    weather_debug("Remembered missing icon %s.", icon);
+    if (G_UNLIKELY(idx < 0))
+        return;
+    theme->missing_icons[idx] |= icon_missing_bit(sizedir, night);
+    weather_debug("Remembered missing icon %s%s%s%s.",
+                  icon_sizedirs[sizedir], G_DIR_SEPARATOR_S,
+                  symbol_names[idx], night ? "-night" : "");
 }
 
 
-static const gchar *
+static guint
 get_icon_sizedir(const gint size)
 {
-    const gchar *sizedir;
+    guint sizedir;
 
     if (size < 24)
-        sizedir = ICON_DIR_SMALL;
+        sizedir = 0;
     else if (size < 49)
-        sizedir = ICON_DIR_MEDIUM;
+        sizedir = 1;
     else
-        sizedir = ICON_DIR_BIG;
+        sizedir = 2;
     return sizedir;
 }
 
 
+typedef struct {
+    gchar *key;
+    GdkPixbuf *pixbuf;
+} cached_icon;
+
+
+static void
+cached_icon_free(cached_icon *icon)
+{
+    g_free(icon->key);
+    g_object_unref(G_OBJECT(icon->pixbuf));
+    g_slice_free(cached_icon, icon);
+}
+
+
+static void
+icon_atlas_unref(gpointer atlas)
+{
+    /* pending atlases are NULL */
+    if (atlas)
+        g_object_unref(G_OBJECT(atlas));
+}
+
+
+static icon_cache *
+icon_cache_new(void)
+{
+    icon_cache *cache = g_slice_new0(icon_cache);
+
+    /* keys are owned by the cached_icon structs in the queue */
+    cache->pixbufs = g_hash_table_new(g_str_hash, g_str_equal);
+    cache->lru = g_queue_new();
+    cache->atlases = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+                                           NULL, icon_atlas_unref);
+    cache->atlas_requests = g_hash_table_new(g_direct_hash, g_direct_equal);
+    cache->cancellable = g_cancellable_new();
+    return cache;
+}
+
+
+static void
+icon_cache_free(icon_cache *cache)
+{
+    cached_icon *icon;
+
+    while ((icon = g_queue_pop_head(cache->lru)))
+        cached_icon_free(icon);
+    g_queue_free(cache->lru);
+    g_hash_table_destroy(cache->pixbufs);
+    g_hash_table_destroy(cache->atlases);
+    if (cache->atlas_timer)
+        g_source_remove(cache->atlas_timer);
+    g_hash_table_destroy(cache->atlas_requests);
+
+    /* stop pending icon requests, which still refer to the theme */
+    g_cancellable_cancel(cache->cancellable);
+    g_object_unref(cache->cancellable);
+    g_slice_free(icon_cache, cache);
+}
+
+
 static gchar *
-make_icon_filename(const icon_theme *theme,
+make_icon_filename(const gchar *themedir,
                    const gchar *sizedir,
                    const gchar *symbol_name,
                    const gchar *suffix)
@@ -132,7 +240,7 @@ make_icon_filename(const icon_theme *theme,
     gchar *filename, *symlow;
 
     symlow = g_ascii_strdown(symbol_name, -1);
-    filename = g_strconcat(theme->dir, G_DIR_SEPARATOR_S, sizedir,
+    filename = g_strconcat(themedir, G_DIR_SEPARATOR_S, sizedir,
                            G_DIR_SEPARATOR_S, symlow, suffix, ".png", NULL);
     g_free(symlow);
     return filename;
@@ -170,25 +278,26 @@ quiet_gdk_pixbuf_new_from_file_at_scale(const char *filename,
 }
 
 
-GdkPixbuf *
-get_icon(const icon_theme *theme,
-         const gchar *symbol_name,
-         const gint size,
-         const gboolean night)
+/*
+ * Load an icon by symbol name. idx is the index of the name in
+ * symbol_names as resolved by the caller, or -1 for unknown names.
+ */
+static GdkPixbuf *
+load_icon(const icon_theme *theme,
+          const gchar *symbol_name,
+          const gint idx,
+          const gint size,
+          const gboolean night)
 {
     GdkPixbuf *image = NULL;
     const gchar *sizedir;
     gchar *filename = NULL, *suffix = "";
     GError *error = NULL;
-
-    g_assert(theme != NULL);
-    if (G_UNLIKELY(!theme)) {
-        g_warning(_("No icon theme!"));
-        return NULL;
-    }
+    guint sizedir_idx;
 
     /* choose icons from directory best matching the requested size */
-    sizedir = get_icon_sizedir(size);
+    sizedir_idx = get_icon_sizedir(size);
+    sizedir = icon_sizedirs[sizedir_idx];
 
     if (symbol_name == NULL || strlen(symbol_name) == 0)
         symbol_name = symbol_names[SYMBOL_NODATA];
@@ -196,8 +305,8 @@ get_icon(const icon_theme *theme,
         suffix = "-night";
 
     /* check whether icon has been verified to be missing before */
-    if (!icon_missing(theme, sizedir, symbol_name, suffix)) {
-        filename = make_icon_filename(theme, sizedir, symbol_name, suffix);
+    if (!icon_missing(theme, sizedir_idx, idx, *suffix != '\0')) {
+        filename = make_icon_filename(theme->dir, sizedir, symbol_name, suffix);
         image = quiet_gdk_pixbuf_new_from_file_at_scale(filename, size, size, TRUE, &error);
     }
 
@@ -209,7 +318,8 @@ get_icon(const icon_theme *theme,
         }
         if (filename) {
             weather_debug("Unable to open image: %s", filename);
-            remember_missing_icon(theme, sizedir, symbol_name, suffix);
+            remember_missing_icon(theme, sizedir_idx, idx,
+                                  *suffix != '\0');
             g_free(filename);
             filename = NULL;
         }
@@ -217,10 +327,10 @@ get_icon(const icon_theme *theme,
         if (strcmp(symbol_name, symbol_names[SYMBOL_NODATA]))
             if (night)
                 /* maybe there is no night icon, so fallback to using day icon... */
-                return get_icon(theme, symbol_name, size, FALSE);
+                return load_icon(theme, symbol_name, idx, size, FALSE);
             else
                 /* ... or use NODATA if we tried that already */
-                return get_icon(theme, NULL, size, FALSE);
+                return load_icon(theme, NULL, SYMBOL_NODATA, size, FALSE);
         else {
             /* last chance: get NODATA icon from standard theme */
             filename = make_fallback_icon_filename(sizedir);
@@ -237,6 +347,974 @@ get_icon(const icon_theme *theme,
 }
 
 
+/*
+ * An icon atlas holds all day and night icons of a theme scaled to
+ * one size, side by side in cells of size x size pixels, with the
+ * fallback icons already filled in where the theme lacks one. Atlases
+ * are built in the background on first use of a size and saved to the
+ * user cache directory, so later they only need a single decode.
+ */
+static guint
+icon_atlas_cell(const gint idx,
+                const gboolean night)
+{
+    return idx * 2 + (night ? 1 : 0);
+}
+
+
+static gchar *
+make_icon_atlas_filename(const gchar *themedir,
+                         const gint size)
+{
+    gchar *checksum, *name, *filename;
+
+    /* user and system themes may have the same directory name */
+    checksum = g_compute_checksum_for_string(G_CHECKSUM_MD5, themedir, -1);
+    name = g_strdup_printf("%s-%d.png", checksum, size);
+    filename = g_build_filename(g_get_user_cache_dir(), "xfce4", "weather",
+                                "icons", name, NULL);
+    g_free(checksum);
+    g_free(name);
+    return filename;
+}
+
+
+/* raise newest_t to the modification time of file, if it exists */
+static void
+update_newest_mtime(const gchar *file,
+                    time_t *newest_t)
+{
+    GStatBuf st;
+
+    if (g_stat(file, &st) == 0 && st.st_mtime > *newest_t)
+        *newest_t = st.st_mtime;
+}
+
+
+/*
+ * Get the newest modification time of the files build_icon_atlas
+ * reads, and of the directories holding them, so that added, removed
+ * and replaced icons are all noticed.
+ */
+static time_t
+icon_atlas_sources_mtime(const gchar *themedir,
+                         const gchar *sizedir)
+{
+    gchar *file;
+    time_t newest_t = 0;
+    gint i;
+
+    update_newest_mtime(themedir, &newest_t);
+    file = g_build_filename(themedir, sizedir, NULL);
+    update_newest_mtime(file, &newest_t);
+    g_free(file);
+    file = make_fallback_icon_filename(sizedir);
+    update_newest_mtime(file, &newest_t);
+    g_free(file);
+
+    for (i = 0; i < SYMBOL_COUNT; i++) {
+        file = make_icon_filename(themedir, sizedir, symbol_names[i], "");
+        update_newest_mtime(file, &newest_t);
+        g_free(file);
+        file = make_icon_filename(themedir, sizedir, symbol_names[i],
+                                  "-night");
+        update_newest_mtime(file, &newest_t);
+        g_free(file);
+    }
+    return newest_t;
+}
+
+
+/*
+ * A saved atlas is outdated when any of the icons it has been built
+ * from has been added, removed or changed after it has been written.
+ */
+static gboolean
+icon_atlas_file_is_fresh(const gchar *filename,
+                         const gchar *themedir,
+                         const gchar *sizedir)
+{
+    GStatBuf atlas_st;
+
+    if (g_stat(filename, &atlas_st))
+        return FALSE;
+    return icon_atlas_sources_mtime(themedir, sizedir) <= atlas_st.st_mtime;
+}
+
+
+/*
+ * Write an atlas to a temporary file that is then renamed, so that
+ * other plugin instances never read a partly written one.
+ */
+static gboolean
+save_icon_atlas(GdkPixbuf *atlas,
+                const gchar *filename,
+                GError **error)
+{
+    gchar *buffer, *dir;
+    gsize len;
+    gboolean result;
+
+    dir = g_path_get_dirname(filename);
+    g_mkdir_with_parents(dir, 0755);
+    g_free(dir);
+
+    if (!gdk_pixbuf_save_to_buffer(atlas, &buffer, &len, "png", error, NULL))
+        return FALSE;
+    result = g_file_set_contents(filename, buffer, len, error);
+    g_free(buffer);
+    return result;
+}
+
+
+typedef struct {
+    gchar *filename;
+    time_t mtime;
+} atlas_file;
+
+
+static gint
+atlas_file_compare_newest(gconstpointer a,
+                          gconstpointer b)
+{
+    const atlas_file *fa = a, *fb = b;
+
+    return (fa->mtime < fb->mtime) - (fa->mtime > fb->mtime);
+}
+
+
+/*
+ * Every panel size and tooltip style may need an atlas of its own
+ * size. Atlases are touched whenever they are loaded, so remove those
+ * of a theme that have not been used for ICON_ATLAS_MAX_AGE, and all
+ * but the ICON_ATLAS_FILES_MAX most recently used ones. The one that
+ * has just been written is kept.
+ */
+static void
+prune_icon_atlas_files(const gchar *filename)
+{
+    GDir *gdir;
+    GArray *files;
+    atlas_file file;
+    const gchar *name;
+    gchar *dir, *base, *prefix;
+    GStatBuf st;
+    time_t now_t = time(NULL);
+    guint i, kept = 1;
+
+    dir = g_path_get_dirname(filename);
+    base = g_path_get_basename(filename);
+    /* all atlases of a theme share the checksum in front of the size */
+    prefix = g_strndup(base, strrchr(base, '-') - base + 1);
+    gdir = g_dir_open(dir, 0, NULL);
+    if (gdir == NULL) {
+        g_free(dir);
+        g_free(base);
+        g_free(prefix);
+        return;
+    }
+
+    files = g_array_new(FALSE, FALSE, sizeof(atlas_file));
+    while ((name = g_dir_read_name(gdir))) {
+        if (!g_str_has_prefix(name, prefix) ||
+            !g_str_has_suffix(name, ".png") || !strcmp(name, base))
+            continue;
+        file.filename = g_build_filename(dir, name, NULL);
+        file.mtime = g_stat(file.filename, &st) == 0 ? st.st_mtime : 0;
+        g_array_append_val(files, file);
+    }
+    g_dir_close(gdir);
+
+    g_array_sort(files, atlas_file_compare_newest);
+    for (i = 0; i < files->len; i++) {
+        file = g_array_index(files, atlas_file, i);
+        if (kept < ICON_ATLAS_FILES_MAX &&
+            difftime(now_t, file.mtime) <= ICON_ATLAS_MAX_AGE)
+            kept++;
+        else {
+            weather_debug("Removing icon atlas %s.", file.filename);
+            g_unlink(file.filename);
+        }
+        g_free(file.filename);
+    }
+    g_array_free(files, TRUE);
+    g_free(dir);
+    g_free(base);
+    g_free(prefix);
+}
+
+
+static GdkPixbuf *
+load_atlas_icon(const gchar *themedir,
+                const gchar *sizedir,
+                const gchar *symbol_name,
+                const gchar *suffix,
+                const gint size)
+{
+    GdkPixbuf *icon;
+    gchar *filename;
+
+    filename = make_icon_filename(themedir, sizedir, symbol_name, suffix);
+    icon = quiet_gdk_pixbuf_new_from_file_at_scale(filename, size, size,
+                                                   TRUE, NULL);
+    g_free(filename);
+    return icon;
+}
+
+
+static void
+copy_atlas_cell(GdkPixbuf *atlas,
+                GdkPixbuf *icon,
+                const guint cell,
+                const gint size)
+{
+    gint width, height;
+
+    if (G_UNLIKELY(icon == NULL))
+        return;
+
+    /* center icons that are not square */
+    width = MIN(gdk_pixbuf_get_width(icon), size);
+    height = MIN(gdk_pixbuf_get_height(icon), size);
+    gdk_pixbuf_copy_area(icon, 0, 0, width, height, atlas,
+                         cell * size + (size - width) / 2,
+                         (size - height) / 2);
+}
+
+
+/*
+ * Decode all icons of a theme for an atlas, using the same fallbacks
+ * as load_icon. This runs in a worker thread and must not access the
+ * theme struct.
+ */
+static GdkPixbuf *
+build_icon_atlas(const gchar *themedir,
+                 const gint size)
+{
+    GdkPixbuf *atlas, *nodata, *day, *night;
+    const gchar *sizedir;
+    gchar *filename;
+    gint i;
+
+    atlas = gdk_pixbuf_new(GDK_COLORSPACE_RGB, TRUE, 8,
+                           size * ICON_ATLAS_CELLS, size);
+    if (G_UNLIKELY(atlas == NULL))
+        return NULL;
+    gdk_pixbuf_fill(atlas, 0);
+
+    sizedir = icon_sizedirs[get_icon_sizedir(size)];
+    nodata = load_atlas_icon(themedir, sizedir,
+                             symbol_names[SYMBOL_NODATA], "", size);
+    if (nodata == NULL) {
+        filename = make_fallback_icon_filename(sizedir);
+        nodata = quiet_gdk_pixbuf_new_from_file_at_scale(filename, size, size,
+                                                         TRUE, NULL);
+        g_free(filename);
+    }
+
+    for (i = 0; i < SYMBOL_COUNT; i++) {
+        /* polar symbols use the cells of their normal counterparts */
+        if (get_symbol_index(symbol_names[i]) != i)
+            continue;
+
+        day = load_atlas_icon(themedir, sizedir, symbol_names[i], "", size);
+        if (day == NULL && nodata)
+            day = g_object_ref(nodata);
+        night = load_atlas_icon(themedir, sizedir, symbol_names[i],
+                                "-night", size);
+        if (night == NULL && day)
+            night = g_object_ref(day);
+
+        copy_atlas_cell(atlas, day, icon_atlas_cell(i, FALSE), size);
+        copy_atlas_cell(atlas, night, icon_atlas_cell(i, TRUE), size);
+        if (day)
+            g_object_unref(G_OBJECT(day));
+        if (night)
+            g_object_unref(G_OBJECT(night));
+    }
+
+    if (nodata)
+        g_object_unref(G_OBJECT(nodata));
+    return atlas;
+}
+
+
+typedef struct {
+    const icon_theme *theme;
+    gchar *themedir;
+    gint size;
+} icon_atlas_job;
+
+
+static void
+icon_atlas_job_free(icon_atlas_job *job)
+{
+    g_free(job->themedir);
+    g_slice_free(icon_atlas_job, job);
+}
+
+
+static void
+icon_atlas_thread(GTask *task,
+                  gpointer source,
+                  gpointer task_data,
+                  GCancellable *cancellable)
+{
+    icon_atlas_job *job = task_data;
+    GdkPixbuf *atlas = NULL;
+    GError *error = NULL;
+    gchar *filename;
+
+    filename = make_icon_atlas_filename(job->themedir, job->size);
+    if (icon_atlas_file_is_fresh(filename, job->themedir,
+                                 icon_sizedirs[get_icon_sizedir(job->size)])) {
+        atlas = gdk_pixbuf_new_from_file(filename, NULL);
+        if (atlas &&
+            (gdk_pixbuf_get_width(atlas) != job->size * ICON_ATLAS_CELLS ||
+             gdk_pixbuf_get_height(atlas) != job->size)) {
+            g_object_unref(G_OBJECT(atlas));
+            atlas = NULL;
+        }
+        /* mark as recently used for prune_icon_atlas_files; it is
+           fresh, so its sources are older anyway */
+        if (atlas)
+            g_utime(filename, NULL);
+    }
+
+    if (atlas == NULL) {
+        weather_debug("Building icon atlas of size %d for %s.",
+                      job->size, job->themedir);
+        atlas = build_icon_atlas(job->themedir, job->size);
+        if (atlas) {
+            if (save_icon_atlas(atlas, filename, &error))
+                prune_icon_atlas_files(filename);
+            else {
+                weather_debug("Error saving icon atlas %s: %s",
+                              filename, error->message);
+                g_error_free(error);
+            }
+        }
+    }
+    g_free(filename);
+
+    if (atlas)
+        g_task_return_pointer(task, atlas, g_object_unref);
+    else
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                                "Could not build icon atlas");
+}
+
+
+static void
+cb_icon_atlas_built(GObject *source,
+                    GAsyncResult *result,
+                    gpointer user_data)
+{
+    GTask *task = G_TASK(result);
+    icon_atlas_job *job = g_task_get_task_data(task);
+    GdkPixbuf *atlas;
+
+    /* the theme is gone when the task has been cancelled */
+    atlas = g_task_propagate_pointer(task, NULL);
+    if (g_cancellable_is_cancelled(g_task_get_cancellable(task))) {
+        if (atlas)
+            g_object_unref(G_OBJECT(atlas));
+        return;
+    }
+
+    /* keep a failed atlas marked as pending, so it is not retried */
+    if (atlas)
+        g_hash_table_replace(job->theme->cache->atlases,
+                             GINT_TO_POINTER(job->size), atlas);
+}
+
+
+static void
+icon_atlas_start(const icon_theme *theme,
+                 const gint size)
+{
+    icon_atlas_job *job;
+    GTask *task;
+
+    if (g_hash_table_contains(theme->cache->atlases, GINT_TO_POINTER(size)))
+        return;
+
+    /* mark as pending */
+    g_hash_table_insert(theme->cache->atlases, GINT_TO_POINTER(size), NULL);
+
+    job = g_slice_new0(icon_atlas_job);
+    job->theme = theme;
+    job->themedir = g_strdup(theme->dir);
+    job->size = size;
+    task = g_task_new(NULL, theme->cache->cancellable,
+                      cb_icon_atlas_built, NULL);
+    g_task_set_task_data(task, job, (GDestroyNotify) icon_atlas_job_free);
+    g_task_run_in_thread(task, icon_atlas_thread);
+    g_object_unref(task);
+}
+
+
+static gboolean
+cb_icon_atlas_requests(gpointer user_data)
+{
+    const icon_theme *theme = user_data;
+    GHashTableIter iter;
+    gpointer size;
+
+    g_hash_table_iter_init(&iter, theme->cache->atlas_requests);
+    while (g_hash_table_iter_next(&iter, &size, NULL))
+        icon_atlas_start(theme, GPOINTER_TO_INT(size));
+    g_hash_table_remove_all(theme->cache->atlas_requests);
+    theme->cache->atlas_timer = 0;
+    return G_SOURCE_REMOVE;
+}
+
+
+/*
+ * Ask for the atlas of a size. Building one decodes every icon of the
+ * theme, so this waits until no new size has been asked for during
+ * ICON_ATLAS_DELAY. Sizes that have been given up meanwhile, because
+ * the panel has been resized or the theme has been replaced, like the
+ * one of the placeholder icon at startup, are never built.
+ */
+static void
+icon_atlas_request(const icon_theme *theme,
+                   const gint size)
+{
+    icon_cache *cache = theme->cache;
+
+    if (size < 1 ||
+        g_hash_table_contains(cache->atlases, GINT_TO_POINTER(size)) ||
+        g_hash_table_contains(cache->atlas_requests, GINT_TO_POINTER(size)))
+        return;
+
+    g_hash_table_add(cache->atlas_requests, GINT_TO_POINTER(size));
+    if (cache->atlas_timer)
+        g_source_remove(cache->atlas_timer);
+    cache->atlas_timer = g_timeout_add_seconds(ICON_ATLAS_DELAY,
+                                               cb_icon_atlas_requests,
+                                               (gpointer) theme);
+}
+
+
+/*
+ * Get an icon as a view into the atlas for its size, sharing the
+ * pixels instead of decoding them. Returns NULL if there is no atlas
+ * yet.
+ */
+static GdkPixbuf *
+icon_atlas_lookup(const icon_theme *theme,
+                  const gint idx,
+                  const gint size,
+                  const gboolean night)
+{
+    GdkPixbuf *atlas;
+
+    if (G_UNLIKELY(idx < 0))
+        return NULL;
+    atlas = g_hash_table_lookup(theme->cache->atlases, GINT_TO_POINTER(size));
+    if (atlas == NULL)
+        return NULL;
+
+    theme->cache->hits++;
+    return gdk_pixbuf_new_subpixbuf(atlas, icon_atlas_cell(idx, night) * size,
+                                    0, size, size);
+}
+
+
+/*
+ * Resolve the index of a symbol once for a lookup. Empty symbols
+ * stand for NODATA, which has no night icon.
+ */
+static gint
+resolve_symbol(const gchar *symbol_name,
+               gboolean *night)
+{
+    if (symbol_name == NULL || *symbol_name == '\0') {
+        *night = FALSE;
+        return SYMBOL_NODATA;
+    }
+    return get_symbol_index(symbol_name);
+}
+
+
+static gchar *
+make_icon_cache_key(const gchar *symbol_name,
+                    const gint size,
+                    const gboolean night)
+{
+    gboolean has_symbol;
+
+    has_symbol = (symbol_name != NULL && strlen(symbol_name) > 0);
+    return g_strdup_printf("%s" G_DIR_SEPARATOR_S "%s%s/%d",
+                           icon_sizedirs[get_icon_sizedir(size)],
+                           has_symbol ? symbol_name : symbol_names[SYMBOL_NODATA],
+                           (has_symbol && night) ? "-night" : "",
+                           size);
+}
+
+
+static GdkPixbuf *
+icon_cache_lookup(icon_cache *cache,
+                  const gchar *key)
+{
+    cached_icon *icon;
+    GList *link;
+
+    link = g_hash_table_lookup(cache->pixbufs, key);
+    if (link == NULL)
+        return NULL;
+
+    cache->hits++;
+    g_queue_unlink(cache->lru, link);
+    g_queue_push_head_link(cache->lru, link);
+    icon = link->data;
+    return g_object_ref(icon->pixbuf);
+}
+
+
+/*
+ * Add a loaded icon to the cache, taking ownership of key.
+ */
+static void
+icon_cache_insert(icon_cache *cache,
+                  gchar *key,
+                  GdkPixbuf *pixbuf)
+{
+    cached_icon *icon;
+
+    /* another request might have loaded the same icon meanwhile */
+    if (G_UNLIKELY(g_hash_table_contains(cache->pixbufs, key))) {
+        g_free(key);
+        return;
+    }
+
+    icon = g_slice_new0(cached_icon);
+    icon->key = key;
+    icon->pixbuf = g_object_ref(pixbuf);
+    g_queue_push_head(cache->lru, icon);
+    g_hash_table_insert(cache->pixbufs, icon->key, cache->lru->head);
+
+    if (cache->lru->length > ICON_CACHE_SIZE) {
+        icon = g_queue_pop_tail(cache->lru);
+        g_hash_table_remove(cache->pixbufs, icon->key);
+        cached_icon_free(icon);
+    }
+}
+
+
+/*
+ * Get an icon from the theme, preferring an already loaded one. The
+ * caller owns a reference to the returned pixbuf and must not modify
+ * it, as it is shared with the cache.
+ */
+GdkPixbuf *
+get_icon(const icon_theme *theme,
+         const gchar *symbol_name,
+         const gint size,
+         const gboolean night)
+{
+    GdkPixbuf *image;
+    gchar *key;
+    gboolean atlas_night = night;
+    gint idx;
+
+    g_assert(theme != NULL);
+    if (G_UNLIKELY(!theme)) {
+        g_warning(_("No icon theme!"));
+        return NULL;
+    }
+
+    idx = resolve_symbol(symbol_name, &atlas_night);
+    image = icon_atlas_lookup(theme, idx, size, atlas_night);
+    if (image)
+        return image;
+    icon_atlas_request(theme, size);
+
+    key = make_icon_cache_key(symbol_name, size, night);
+    image = icon_cache_lookup(theme->cache, key);
+    if (image) {
+        g_free(key);
+        return image;
+    }
+
+    theme->cache->misses++;
+    image = load_icon(theme, symbol_name, idx, size, night);
+    if (G_LIKELY(image))
+        icon_cache_insert(theme->cache, key, image);
+    else
+        g_free(key);
+    return image;
+}
+
+
+/*
+ * Get an icon only if it has already been loaded, without touching
+ * the disk. Returns NULL otherwise.
+ */
+GdkPixbuf *
+get_icon_cached(const icon_theme *theme,
+                const gchar *symbol_name,
+                const gint size,
+                const gboolean night)
+{
+    GdkPixbuf *image;
+    gchar *key;
+    gboolean atlas_night = night;
+    gint idx;
+
+    g_assert(theme != NULL);
+    if (G_UNLIKELY(!theme))
+        return NULL;
+
+    idx = resolve_symbol(symbol_name, &atlas_night);
+    image = icon_atlas_lookup(theme, idx, size, atlas_night);
+    if (image)
+        return image;
+
+    key = make_icon_cache_key(symbol_name, size, night);
+    image = icon_cache_lookup(theme->cache, key);
+    g_free(key);
+    return image;
+}
+
+
+typedef struct {
+    const icon_theme *theme;
+    GCancellable *theme_cancellable;
+    gchar *key;
+    gchar *symbol_name;
+    gint symbol_idx;            /* see get_symbol_index */
+    gint size;
+    guint sizedir;
+    gboolean night;
+    gboolean fallback;
+} icon_request;
+
+
+static void
+icon_request_free(icon_request *req)
+{
+    g_object_unref(req->theme_cancellable);
+    g_free(req->key);
+    g_free(req->symbol_name);
+    g_slice_free(icon_request, req);
+}
+
+
+/*
+ * Move on to the next icon to try, in the same order as load_icon:
+ * the day icon, then NODATA, then NODATA from the standard theme.
+ */
+static void
+icon_request_fall_back(icon_request *req)
+{
+    if (req->night)
+        req->night = FALSE;
+    else if (strcmp(req->symbol_name, symbol_names[SYMBOL_NODATA])) {
+        g_free(req->symbol_name);
+        req->symbol_name = g_strdup(symbol_names[SYMBOL_NODATA]);
+        req->symbol_idx = SYMBOL_NODATA;
+    } else
+        req->fallback = TRUE;
+}
+
+
+/*
+ * Finish the task if loading has been cancelled, either by the caller
+ * or because the theme has been freed. The theme must not be accessed
+ * anymore in the latter case.
+ */
+static gboolean
+icon_request_cancelled(GTask *task,
+                       const GError *error)
+{
+    icon_request *req = g_task_get_task_data(task);
+
+    if (!g_cancellable_is_cancelled(req->theme_cancellable) &&
+        !g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        return FALSE;
+
+    g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                            "Loading icon %s cancelled", req->key);
+    g_object_unref(task);
+    return TRUE;
+}
+
+
+static void icon_request_start(GTask *task);
+
+
+static void
+icon_request_failed(GTask *task)
+{
+    icon_request *req = g_task_get_task_data(task);
+
+    if (req->fallback) {
+        g_warning("Failed to open fallback icon from standard theme "
+                  "for %s", req->key);
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_NOT_FOUND,
+                                "No icon found for %s", req->key);
+        g_object_unref(task);
+        return;
+    }
+
+    /* remember failure for future lookups */
+    remember_missing_icon(req->theme, req->sizedir,
+                          req->symbol_idx, req->night);
+    icon_request_fall_back(req);
+    icon_request_start(task);
+}
+
+
+static void
+cb_icon_decoded(GObject *source,
+                GAsyncResult *result,
+                gpointer user_data)
+{
+    GTask *task = user_data;
+    icon_request *req = g_task_get_task_data(task);
+    GdkPixbuf *pixbuf;
+    GError *error = NULL;
+
+    pixbuf = gdk_pixbuf_new_from_stream_finish(result, &error);
+    if (icon_request_cancelled(task, error)) {
+        if (pixbuf)
+            g_object_unref(G_OBJECT(pixbuf));
+        g_clear_error(&error);
+        return;
+    }
+
+    if (pixbuf == NULL) {
+        weather_debug("Failed to load pixbuf for %s: %s",
+                      req->key, error->message);
+        g_error_free(error);
+        icon_request_failed(task);
+        return;
+    }
+
+    icon_cache_insert(req->theme->cache, g_strdup(req->key), pixbuf);
+    g_task_return_pointer(task, pixbuf, g_object_unref);
+    g_object_unref(task);
+}
+
+
+static void
+cb_icon_file_read(GObject *source,
+                  GAsyncResult *result,
+                  gpointer user_data)
+{
+    GTask *task = user_data;
+    icon_request *req = g_task_get_task_data(task);
+    GFileInputStream *stream;
+    GError *error = NULL;
+
+    stream = g_file_read_finish(G_FILE(source), result, &error);
+    if (icon_request_cancelled(task, error)) {
+        if (stream)
+            g_object_unref(stream);
+        g_clear_error(&error);
+        return;
+    }
+
+    if (stream == NULL) {
+        weather_debug("Unable to open image for %s: %s",
+                      req->key, error->message);
+        g_error_free(error);
+        icon_request_failed(task);
+        return;
+    }
+
+    gdk_pixbuf_new_from_stream_at_scale_async(G_INPUT_STREAM(stream),
+                                              MAX(req->size, 1),
+                                              MAX(req->size, 1),
+                                              TRUE,
+                                              g_task_get_cancellable(task),
+                                              cb_icon_decoded, task);
+    g_object_unref(stream);
+}
+
+
+static void
+icon_request_start(GTask *task)
+{
+    icon_request *req = g_task_get_task_data(task);
+    GFile *file;
+    gchar *filename;
+
+    /* skip icons verified to be missing before */
+    while (!req->fallback &&
+           icon_missing(req->theme, req->sizedir,
+                        req->symbol_idx, req->night))
+        icon_request_fall_back(req);
+
+    if (req->fallback)
+        filename = make_fallback_icon_filename(icon_sizedirs[req->sizedir]);
+    else
+        filename = make_icon_filename(req->theme->dir,
+                                      icon_sizedirs[req->sizedir],
+                                      req->symbol_name,
+                                      req->night ? "-night" : "");
+
+    file = g_file_new_for_path(filename);
+    g_file_read_async(file, G_PRIORITY_DEFAULT,
+                      g_task_get_cancellable(task),
+                      cb_icon_file_read, task);
+    g_object_unref(file);
+    g_free(filename);
+}
+
+
+/*
+ * Load an icon like get_icon, but read and decode it without blocking
+ * the main loop. Loading stops when cancellable is cancelled or when
+ * the theme is freed.
+ */
+void
+get_icon_async(const icon_theme *theme,
+               const gchar *symbol_name,
+               const gint size,
+               const gboolean night,
+               GCancellable *cancellable,
+               GAsyncReadyCallback callback,
+               gpointer user_data)
+{
+    GTask *task;
+    icon_request *req;
+    GdkPixbuf *image;
+    gboolean has_symbol, atlas_night = night;
+    gint idx;
+
+    task = g_task_new(NULL, cancellable, callback, user_data);
+
+    g_assert(theme != NULL);
+    if (G_UNLIKELY(!theme)) {
+        g_task_return_new_error(task, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+                                "No icon theme!");
+        g_object_unref(task);
+        return;
+    }
+
+    has_symbol = (symbol_name != NULL && strlen(symbol_name) > 0);
+    idx = resolve_symbol(symbol_name, &atlas_night);
+    req = g_slice_new0(icon_request);
+    req->theme = theme;
+    req->theme_cancellable = g_object_ref(theme->cache->cancellable);
+    req->key = make_icon_cache_key(symbol_name, size, night);
+    req->symbol_name = g_strdup(has_symbol
+                                ? symbol_name
+                                : symbol_names[SYMBOL_NODATA]);
+    req->symbol_idx = idx;
+    req->size = size;
+    req->sizedir = get_icon_sizedir(size);
+    req->night = (has_symbol && night);
+    g_task_set_task_data(task, req, (GDestroyNotify) icon_request_free);
+
+    image = icon_atlas_lookup(theme, idx, size, atlas_night);
+    if (image == NULL)
+        image = icon_cache_lookup(theme->cache, req->key);
+    if (image) {
+        g_task_return_pointer(task, image, g_object_unref);
+        g_object_unref(task);
+        return;
+    }
+
+    /* until the atlas is ready, load the single icon */
+    icon_atlas_request(theme, size);
+    theme->cache->misses++;
+    icon_request_start(task);
+}
+
+
+GdkPixbuf *
+get_icon_finish(GAsyncResult *result,
+                GError **error)
+{
+    g_assert(g_task_is_valid(result, NULL));
+    return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+
+static void
+cb_image_icon_loaded(GObject *source,
+                     GAsyncResult *result,
+                     gpointer user_data)
+{
+    GtkImage *image = user_data;
+    GdkPixbuf *icon;
+
+    icon = get_icon_finish(result, NULL);
+    if (icon) {
+        gtk_image_set_from_pixbuf(image, icon);
+        g_object_unref(G_OBJECT(icon));
+    }
+    g_object_unref(image);
+}
+
+
+/*
+ * Show an icon in an image, right away if it has been loaded before
+ * and otherwise as soon as it has been loaded in the background.
+ * Meanwhile, the image keeps its current contents as a placeholder,
+ * or takes up the space of the icon if it is empty.
+ */
+void
+icon_image_set_async(GtkImage *image,
+                     const icon_theme *theme,
+                     const gchar *symbol_name,
+                     const gint size,
+                     const gboolean night,
+                     GCancellable *cancellable)
+{
+    GdkPixbuf *icon;
+
+    icon = get_icon_cached(theme, symbol_name, size, night);
+    if (icon) {
+        gtk_image_set_from_pixbuf(image, icon);
+        g_object_unref(G_OBJECT(icon));
+        return;
+    }
+
+    if (gtk_image_get_storage_type(image) == GTK_IMAGE_EMPTY)
+        gtk_widget_set_size_request(GTK_WIDGET(image), size, size);
+    get_icon_async(theme, symbol_name, size, night, cancellable,
+                   cb_image_icon_loaded, g_object_ref(image));
+}
+
+
+static gboolean
+icon_atlas_is_built(gpointer size,
+                    gpointer atlas,
+                    gpointer user_data)
+{
+    return atlas != NULL;
+}
+
+
+/*
+ * Drop all loaded icons, e.g. when the panel size changes and the
+ * cached sizes will not be requested again.
+ */
+void
+icon_theme_clear_cache(const icon_theme *theme)
+{
+    cached_icon *icon;
+
+    g_assert(theme != NULL);
+    if (G_UNLIKELY(theme == NULL))
+        return;
+
+    while ((icon = g_queue_pop_head(theme->cache->lru)))
+        cached_icon_free(icon);
+    g_hash_table_remove_all(theme->cache->pixbufs);
+    g_hash_table_foreach_remove(theme->cache->atlases,
+                                icon_atlas_is_built, NULL);
+    /* sizes asked for before are likely not used anymore */
+    g_hash_table_remove_all(theme->cache->atlas_requests);
+    weather_debug("Cleared icon cache of theme %s.", theme->dir);
+}
+
+
 /*
  * Create a new icon theme struct, initializing caches to undefined.
  */
@@ -248,7 +1326,8 @@ make_icon_theme(void)
     g_assert(theme != NULL);
     if (theme == NULL)
         return NULL;
-    theme->missing_icons = g_array_new(FALSE, TRUE, sizeof(gchar *));
+    theme->missing_icons = g_new0(guint8, SYMBOL_COUNT);
+    theme->cache = icon_cache_new();
     return theme;
 }
 
@@ -505,9 +1584,6 @@ icon_theme_copy(icon_theme *src)
 void
 icon_theme_free(icon_theme *theme)
 {
-    gchar *missing;
-    guint i;
-
     g_assert(theme != NULL);
     if (G_UNLIKELY(theme == NULL))
         return;
@@ -516,10 +1592,7 @@ icon_theme_free(icon_theme *theme)
     g_free(theme->author);
     g_free(theme->description);
     g_free(theme->license);
-    for (i = 0; i < theme->missing_icons->len; i++) {
-        missing = g_array_index(theme->missing_icons, gchar *, i);
-        g_free(missing);
-    }
-    g_array_free(theme->missing_icons, FALSE);
+    g_free(theme->missing_icons);
+    icon_cache_free(theme->cache);
     g_slice_free(icon_theme, theme);
 }
@@ -49,13 +49,26 @@ typedef enum {
     SYMBOL_COUNT
 } symbol_ids;
 
+/* least recently used icons, most recent first */
+typedef struct {
+    GHashTable *pixbufs;
+    GQueue *lru;
+    GHashTable *atlases;        /* size -> atlas, NULL while pending */
+    GHashTable *atlas_requests; /* sizes waiting for ICON_ATLAS_DELAY */
+    guint atlas_timer;
+    guint hits;
+    guint misses;
+    GCancellable *cancellable;  /* cancelled when the theme is freed */
+} icon_cache;
+
 typedef struct {
     gchar *dir;
     gchar *name;
     gchar *author;
     gchar *description;
     gchar *license;
-    GArray *missing_icons;
+    guint8 *missing_icons;      /* bitmap per symbol, see icon_missing */
+    icon_cache *cache;
 } icon_theme;
 
 
@@ -64,6 +77,29 @@ GdkPixbuf *get_icon(const icon_theme *theme,
                     gint size,
                     gboolean night);
 
+GdkPixbuf *get_icon_cached(const icon_theme *theme,
+                           const gchar *icon,
+                           gint size,
+                           gboolean night);
+
+void get_icon_async(const icon_theme *theme,
+                    const gchar *icon,
+                    gint size,
+                    gboolean night,
+                    GCancellable *cancellable,
+                    GAsyncReadyCallback callback,
+                    gpointer user_data);
+
+GdkPixbuf *get_icon_finish(GAsyncResult *result,
+                           GError **error);
+
+void icon_image_set_async(GtkImage *image,
+                          const icon_theme *theme,
+                          const gchar *icon,
+                          gint size,
+                          gboolean night,
+                          GCancellable *cancellable);
+
 icon_theme *icon_theme_load_info(const gchar *dir);
 
 icon_theme *icon_theme_load(const gchar *dir);
@@ -74,6 +110,8 @@ GArray *find_icon_themes(void);
 
 icon_theme *icon_theme_copy(icon_theme *src);
 
+void icon_theme_clear_cache(const icon_theme *theme);
+
 void icon_theme_free(icon_theme *theme);
 
 const gchar *get_symbol_name (gint idx);
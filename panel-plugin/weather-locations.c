@@ -0,0 +1,408 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <libxfce4util/libxfce4util.h>
+
+#include "weather-parsers.h"
+#include "weather-data.h"
+#include "weather.h"
+#include "weather-cache.h"
+#include "weather-locations.h"
+#include "weather-debug.h"
+
+
+static void
+location_update_conditions(weather_location *loc,
+                           time_t conditions_t)
+{
+    if (loc->weatherdata->current_conditions) {
+        xml_time_free(loc->weatherdata->current_conditions);
+        loc->weatherdata->current_conditions = NULL;
+    }
+    loc->weatherdata->current_conditions =
+        make_current_conditions(loc->weatherdata, conditions_t);
+}
+
+
+/*
+ * Generate the file name of the cache file of a location. Additional
+ * locations do not have astrodata, so their files are kept apart from
+ * those of the main location.
+ */
+static gchar *
+location_cache_filename(const weather_location *loc)
+{
+    gchar *cache_dir, *file;
+
+    cache_dir = get_cache_directory();
+    file = g_strdup_printf("%s%slocationdata_%s_%s_%d",
+                           cache_dir, G_DIR_SEPARATOR_S,
+                           loc->lat, loc->lon, loc->msl);
+    g_free(cache_dir);
+    return file;
+}
+
+
+/* the weather data does not depend on the timezone offset */
+static void
+location_cache_info(const weather_location *loc,
+                    weather_cache_info *info)
+{
+    memset(info, 0, sizeof(weather_cache_info));
+    info->location_name = loc->name;
+    info->lat = loc->lat;
+    info->lon = loc->lon;
+    info->offset = "";
+    info->msl = loc->msl;
+}
+
+
+static void
+location_read_cache(weather_location *loc)
+{
+    weather_cache_info info;
+    update_info *upi = loc->weather_update;
+    gchar *file;
+
+    file = location_cache_filename(loc);
+    location_cache_info(loc, &info);
+    if (weather_cache_read(file, &info, loc->data->cache_file_max_age,
+                           NULL, loc->weatherdata) == WEATHER_CACHE_OK) {
+        upi->last = info.last_weather_download;
+        upi->expires = info.weather_expires;
+        upi->last_modified = info.weather_last_modified;
+        g_free(upi->url);
+        upi->url = info.weather_url;
+        info.weather_url = NULL;
+        upi->next = calc_next_download_time(upi, upi->last);
+        xml_weather_clean(loc->weatherdata);
+    }
+    g_free(info.weather_url);
+    g_free(info.astro_url);
+    g_free(file);
+}
+
+
+/*
+ * Write the cache file in the background, handing the download lock
+ * over to the writer.
+ */
+static void
+location_write_cache(weather_location *loc)
+{
+    weather_cache_info info;
+    GBytes *contents;
+    gchar *file;
+
+    location_cache_info(loc, &info);
+    info.cache_date = time(NULL);
+    info.last_weather_download = loc->weather_update->last;
+    info.weather_expires = loc->weather_update->expires;
+    info.weather_last_modified = loc->weather_update->last_modified;
+    info.weather_url = loc->weather_update->url;
+
+    contents = weather_cache_serialize(&info, NULL, loc->weatherdata);
+    if (G_LIKELY(contents)) {
+        file = location_cache_filename(loc);
+        weather_cache_writer_write(loc->data->cache_writer, file, contents,
+                                   loc->download_lock);
+        g_bytes_unref(contents);
+        g_free(file);
+    } else
+        weather_cache_unlock(loc->download_lock);
+    loc->download_lock = -1;
+}
+
+
+/*
+ * Plugin instances showing the same location share its cache file as
+ * they do for the main location. Use data another instance has
+ * downloaded more recently than our own, or wait for its download.
+ * Returns TRUE if the location needs to be downloaded.
+ */
+static gboolean
+location_share_download(weather_location *loc,
+                        time_t now_t)
+{
+    weather_cache_info info;
+    gboolean newer = FALSE;
+    gchar *file;
+
+    if (loc->download_lock >= 0)
+        return TRUE;
+
+    file = location_cache_filename(loc);
+    location_cache_info(loc, &info);
+    if (weather_cache_read(file, &info, loc->data->cache_file_max_age,
+                           NULL, NULL) == WEATHER_CACHE_OK) {
+        newer = (difftime(info.last_weather_download,
+                          loc->weather_update->last) > 0);
+        g_free(info.weather_url);
+        g_free(info.astro_url);
+    }
+    if (newer) {
+        weather_debug("Using data for %s downloaded by another plugin "
+                      "instance.", loc->name);
+        location_read_cache(loc);
+        location_update_conditions(loc, now_t);
+        if (difftime(loc->weather_update->next, now_t) >
+            LOCATION_BATCH_WINDOW) {
+            g_free(file);
+            return FALSE;
+        }
+    }
+
+    if (!weather_cache_lock(file, &loc->download_lock)) {
+        weather_debug("Another plugin instance is downloading data "
+                      "for %s, waiting for it.", loc->name);
+        loc->weather_update->next = now_t + SHARED_DOWNLOAD_WAIT;
+        g_free(file);
+        return FALSE;
+    }
+    g_free(file);
+    return TRUE;
+}
+
+
+weather_location *
+weather_location_new(plugin_data *data,
+                     const gchar *name,
+                     const gchar *lat,
+                     const gchar *lon,
+                     gint msl)
+{
+    weather_location *loc;
+
+    g_assert(data != NULL && lat != NULL && lon != NULL);
+    if (G_UNLIKELY(data == NULL || lat == NULL || lon == NULL))
+        return NULL;
+
+    loc = g_slice_new0(weather_location);
+    loc->data = data;
+    loc->name = g_strdup(name ? name : "");
+    loc->lat = g_strdup(lat);
+    loc->lon = g_strdup(lon);
+    loc->msl = msl;
+    loc->weather_update = make_update_info(60 * 60);
+    loc->weatherdata = make_weather_data();
+    loc->download_lock = -1;
+
+    location_read_cache(loc);
+    location_update_conditions(loc, time(NULL));
+    return loc;
+}
+
+
+void
+weather_location_free(weather_location *loc)
+{
+    if (G_UNLIKELY(loc == NULL))
+        return;
+
+    if (loc->msg)
+        soup_session_cancel_message(loc->data->session, loc->msg,
+                                    SOUP_STATUS_CANCELLED);
+    if (loc->weather_parser)
+        xml_weather_parser_free(loc->weather_parser);
+    weather_cache_unlock(loc->download_lock);
+    xml_weather_free(loc->weatherdata);
+    update_info_free(loc->weather_update);
+    g_free(loc->name);
+    g_free(loc->lat);
+    g_free(loc->lon);
+    g_slice_free(weather_location, loc);
+}
+
+
+void
+locations_update_conditions(plugin_data *data,
+                            time_t conditions_t)
+{
+    guint i;
+
+    for (i = 0; data->locations && i < data->locations->len; i++)
+        location_update_conditions(g_ptr_array_index(data->locations, i),
+                                   conditions_t);
+}
+
+
+static void
+cb_location_chunk(SoupMessage *msg,
+                  SoupBuffer *chunk,
+                  gpointer user_data)
+{
+    weather_location *loc = user_data;
+
+    if (msg->status_code != 200 && msg->status_code != 203)
+        return;
+
+    if (loc->weather_parser == NULL) {
+        loc->weather_parser = make_weather_parser(msg, loc->weatherdata);
+        if (G_UNLIKELY(loc->weather_parser == NULL))
+            return;
+    }
+    xml_weather_parser_feed(loc->weather_parser, chunk->data, chunk->length);
+}
+
+
+static void
+cb_location_update(SoupSession *session,
+                   SoupMessage *msg,
+                   gpointer user_data)
+{
+    weather_location *loc;
+    update_info *upi;
+    time_t now_t;
+
+    /* cancelled downloads belong to locations that have been freed */
+    if (msg->status_code == SOUP_STATUS_CANCELLED)
+        return;
+
+    loc = user_data;
+    loc->msg = NULL;
+    upi = loc->weather_update;
+
+    time(&now_t);
+    upi->attempt++;
+    upi->http_status_code = msg->status_code;
+    if (msg->status_code == SOUP_STATUS_NOT_MODIFIED) {
+        weather_debug("Weather data for %s not modified.", loc->name);
+        upi->attempt = 0;
+        upi->last = now_t;
+        update_http_validators(upi, msg, now_t);
+    } else if (msg->status_code == 200 || msg->status_code == 203) {
+        if (G_LIKELY(loc->weather_parser) &&
+            xml_weather_parser_finish(loc->weather_parser)) {
+            upi->attempt = 0;
+            upi->last = now_t;
+            update_http_validators(upi, msg, now_t);
+        } else
+            g_warning(_("Error parsing weather data!"));
+        loc->weather_parser = NULL;
+    } else {
+        weather_debug("Download of weather data for %s failed with "
+                      "HTTP status code %d.", loc->name, msg->status_code);
+        if (loc->weather_parser) {
+            xml_weather_parser_free(loc->weather_parser);
+            loc->weather_parser = NULL;
+        }
+    }
+    upi->next = calc_next_download_time(upi, now_t);
+
+    xml_weather_clean(loc->weatherdata);
+    if (upi->attempt == 0)
+        location_write_cache(loc);
+    else {
+        weather_cache_unlock(loc->download_lock);
+        loc->download_lock = -1;
+    }
+    location_update_conditions(loc, loc->data->conditions_update->last
+                               ? loc->data->conditions_update->last
+                               : now_t);
+    update_scrollbox(loc->data, FALSE);
+    schedule_next_wakeup(loc->data);
+    weather_dump(weather_dump_weatherdata, loc->weatherdata);
+}
+
+
+/* check whether the download of any location is due */
+gboolean
+locations_due(const plugin_data *data,
+              time_t now_t)
+{
+    weather_location *loc;
+    guint i;
+
+    for (i = 0; data->locations && i < data->locations->len; i++) {
+        loc = g_ptr_array_index(data->locations, i);
+        if (loc->msg == NULL &&
+            difftime(loc->weather_update->next, now_t) <= 0)
+            return TRUE;
+    }
+    return FALSE;
+}
+
+
+/*
+ * Start the downloads of all locations that are due. If batch is
+ * TRUE because other data is being downloaded already, or if any
+ * location is due, locations that will be due soon are included.
+ */
+void
+locations_download(plugin_data *data,
+                   time_t now_t,
+                   gboolean batch)
+{
+    weather_location *loc;
+    gchar *url;
+    guint i;
+
+    if (data->locations == NULL ||
+        !(batch || locations_due(data, now_t)))
+        return;
+
+    for (i = 0; i < data->locations->len; i++) {
+        loc = g_ptr_array_index(data->locations, i);
+        if (loc->msg != NULL ||
+            difftime(loc->weather_update->next, now_t) >
+            LOCATION_BATCH_WINDOW ||
+            !location_share_download(loc, now_t))
+            continue;
+
+        /* real next update time will be calculated when the download
+           is finished */
+        loc->weather_update->next = now_t + 3600;
+
+        url = make_forecast_url(loc->lat, loc->lon, loc->msl);
+        g_message(_("getting %s"), url);
+        loc->msg =
+            weather_http_queue_request_chunked(data->session, url,
+                                               get_http_validator(loc->weather_update,
+                                                                  url),
+                                               G_CALLBACK(cb_location_chunk),
+                                               cb_location_update, loc);
+        g_free(url);
+    }
+}
+
+
+/* get the earliest download time of all locations */
+gboolean
+locations_next_download(const plugin_data *data,
+                        time_t *next_t)
+{
+    weather_location *loc;
+    gboolean found = FALSE;
+    guint i;
+
+    for (i = 0; data->locations && i < data->locations->len; i++) {
+        loc = g_ptr_array_index(data->locations, i);
+        if (loc->msg)
+            continue;
+        if (!found || difftime(loc->weather_update->next, *next_t) < 0)
+            *next_t = loc->weather_update->next;
+        found = TRUE;
+    }
+    return found;
+}
@@ -0,0 +1,71 @@
+/*  Copyright (c) 2003-2014 Xfce Development Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __WEATHER_LOCATIONS_H__
+#define __WEATHER_LOCATIONS_H__
+
+G_BEGIN_DECLS
+
+/* downloads due within this time are started along with others that
+   are due already, so that they share a wakeup */
+#define LOCATION_BATCH_WINDOW (15 * 60)
+
+/*
+ * Additional location, shown in the scrollbox and the tooltip next to
+ * the main one. Only weather data is downloaded for it, which is kept
+ * in a cache file of its own.
+ */
+typedef struct {
+    plugin_data *data;
+    gchar *name;
+    gchar *lat;
+    gchar *lon;
+    gint msl;
+
+    update_info *weather_update;
+    xml_weather *weatherdata;
+    xml_weather_parser *weather_parser;
+    SoupMessage *msg;               /* download in progress */
+    gint download_lock;             /* shared with other instances */
+} weather_location;
+
+
+weather_location *weather_location_new(plugin_data *data,
+                                       const gchar *name,
+                                       const gchar *lat,
+                                       const gchar *lon,
+                                       gint msl);
+
+void weather_location_free(weather_location *loc);
+
+gboolean locations_due(const plugin_data *data,
+                       time_t now_t);
+
+void locations_download(plugin_data *data,
+                        time_t now_t,
+                        gboolean batch);
+
+gboolean locations_next_download(const plugin_data *data,
+                                 time_t *next_t);
+
+void locations_update_conditions(plugin_data *data,
+                                 time_t conditions_t);
+
+G_END_DECLS
+
+#endif
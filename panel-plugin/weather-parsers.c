@@ -28,6 +28,7 @@
 #define _XOPEN_SOURCE
 #define _XOPEN_SOURCE_EXTENDED 1
 #include "weather-parsers.h"
+#include "weather-data.h"
 #include "weather-translate.h"
 #include "weather-debug.h"
 
@@ -48,6 +49,9 @@
 #define NODE_IS_TYPE(node, type)                        \
     (xmlStrEqual(node->name, (const xmlChar *) type))
 
+#define NAME_IS(name, type)                             \
+    (xmlStrEqual((name), (const xmlChar *) type))
+
 
 /*
  * This is a portable replacement for the deprecated timegm(),
@@ -103,29 +107,197 @@ extract_double(gchar *str)
 }
 
 
+static guint
+xml_time_hash(gconstpointer key)
+{
+    const xml_time *timeslice = key;
+
+    return (guint) timeslice->start * 31 + (guint) timeslice->end;
+}
+
+
+static gboolean
+xml_time_equal(gconstpointer a,
+               gconstpointer b)
+{
+    const xml_time *ts1 = a, *ts2 = b;
+
+    return ts1->start == ts2->start && ts1->end == ts2->end;
+}
+
+
+/*
+ * Look up the timeslice for the given interval in the index.
+ */
 xml_time *
 get_timeslice(xml_weather *wd,
               const time_t start_t,
-              const time_t end_t,
-              guint *index)
+              const time_t end_t)
+{
+    xml_time key;
+
+    g_assert(wd != NULL);
+    if (G_UNLIKELY(wd == NULL))
+        return NULL;
+
+    key.start = start_t;
+    key.end = end_t;
+    return g_hash_table_lookup(wd->timeslice_index, &key);
+}
+
+
+/*
+ * Append a timeslice to the weather data and add it to the index. The
+ * timeslice must not yet be known, and its interval must not change
+ * afterwards.
+ */
+void
+xml_weather_add_timeslice(xml_weather *wd,
+                          xml_time *timeslice)
+{
+    g_assert(wd != NULL && timeslice != NULL);
+    if (G_UNLIKELY(wd == NULL || timeslice == NULL))
+        return;
+
+    g_array_append_val(wd->timeslices, timeslice);
+    g_hash_table_add(wd->timeslice_index, timeslice);
+    xml_weather_invalidate(wd);
+}
+
+
+static void
+xml_time_columns_free(xml_time_columns *columns)
+{
+    if (G_UNLIKELY(columns == NULL))
+        return;
+    g_free(columns->start);
+    g_free(columns->end);
+    g_free(columns->interval);
+    g_free(columns->timeslices);
+    g_free(columns->by_end);
+    g_slice_free(xml_time_columns, columns);
+}
+
+
+/* like xml_time_compare(), but comparing end times first */
+static gint
+xml_time_compare_end(gconstpointer a,
+                     gconstpointer b)
 {
+    const xml_time *ts1 = *(xml_time **) a;
+    const xml_time *ts2 = *(xml_time **) b;
+
+    if (ts1->end != ts2->end)
+        return (ts1->end < ts2->end) ? -1 : 1;
+    if (ts1->start != ts2->start)
+        return (ts1->start < ts2->start) ? -1 : 1;
+    return 0;
+}
+
+
+/*
+ * Return the columnar view of the timeslices, building it first if
+ * the timeslices have changed since it has been used last time.
+ */
+const xml_time_columns *
+xml_weather_get_columns(xml_weather *wd)
+{
+    xml_time_columns *columns;
     xml_time *timeslice;
-    guint i;
+    guint i, len = 0;
 
     g_assert(wd != NULL);
     if (G_UNLIKELY(wd == NULL))
         return NULL;
 
+    if (G_LIKELY(wd->columns))
+        return wd->columns;
+
+    columns = g_slice_new0(xml_time_columns);
+    columns->timeslices = g_new(xml_time *, wd->timeslices->len);
     for (i = 0; i < wd->timeslices->len; i++) {
         timeslice = g_array_index(wd->timeslices, xml_time *, i);
-        if (timeslice &&
-            timeslice->start == start_t && timeslice->end == end_t) {
-            if (index != NULL)
-                *index = i;
-            return timeslice;
-        }
+        if (G_LIKELY(timeslice))
+            columns->timeslices[len++] = timeslice;
     }
-    return NULL;
+    qsort(columns->timeslices, len, sizeof(xml_time *), xml_time_compare);
+
+    columns->len = len;
+    columns->start = g_new(time_t, len);
+    columns->end = g_new(time_t, len);
+    columns->interval = g_new(gboolean, len);
+    for (i = 0; i < len; i++) {
+        timeslice = columns->timeslices[i];
+        columns->start[i] = timeslice->start;
+        columns->end[i] = timeslice->end;
+        columns->interval[i] = timeslice_is_interval(timeslice);
+    }
+    columns->by_end = g_new(xml_time *, len);
+    memcpy(columns->by_end, columns->timeslices, len * sizeof(xml_time *));
+    qsort(columns->by_end, len, sizeof(xml_time *), xml_time_compare_end);
+    weather_debug("Built timeslice columns for %u timeslices.", len);
+
+    wd->columns = columns;
+    return columns;
+}
+
+
+/*
+ * Return the index of the first timeslice in columns that does not
+ * start before start_t, or the number of timeslices if there is none.
+ */
+guint
+xml_time_columns_search(const xml_time_columns *columns,
+                        const time_t start_t)
+{
+    guint low = 0, high = columns->len, mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (columns->start[mid] < start_t)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+
+/*
+ * Return the position in columns->by_end of the first timeslice that
+ * does not end before end_t, or the number of timeslices if there is
+ * none.
+ */
+guint
+xml_time_columns_search_end(const xml_time_columns *columns,
+                            const time_t end_t)
+{
+    guint low = 0, high = columns->len, mid;
+
+    while (low < high) {
+        mid = low + (high - low) / 2;
+        if (columns->by_end[mid]->end < end_t)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low;
+}
+
+
+/*
+ * Drop data derived from the timeslices. This needs to be called
+ * whenever timeslices are added, removed or their data is replaced.
+ */
+void
+xml_weather_invalidate(xml_weather *wd)
+{
+    g_assert(wd != NULL);
+    if (G_UNLIKELY(wd == NULL))
+        return;
+
+    xml_time_columns_free(wd->columns);
+    wd->columns = NULL;
 }
 
 
@@ -210,100 +382,176 @@ parse_moonposition (gdouble pos) {
 }
 
 
+/*
+ * Attribute accessor, so that the DOM and the SAX parser can share
+ * the code that fills in the data structures.
+ */
+typedef gchar *(*PropFunc) (gconstpointer source,
+                            const gchar *prop);
+
+typedef struct {
+    gint nb_attributes;
+    const xmlChar **attributes;
+} sax_attributes;
+
+
+static gchar *
+node_prop(gconstpointer source,
+          const gchar *prop)
+{
+    return PROP((xmlNode *) source, prop);
+}
+
+
+static gchar *
+sax_prop(gconstpointer source,
+         const gchar *prop)
+{
+    const sax_attributes *attrs = source;
+    const xmlChar **attr;
+    gint i;
+
+    /* SAX2 attributes come as (localname, prefix, URI, value, end) */
+    for (i = 0; i < attrs->nb_attributes; i++) {
+        attr = attrs->attributes + i * 5;
+        if (xmlStrEqual(attr[0], (const xmlChar *) prop))
+            return g_strndup((const gchar *) attr[3], attr[4] - attr[3]);
+    }
+    return NULL;
+}
+
+
+/*
+ * Convert the attribute to a number once, so that it doesn't have to
+ * be done over and over again later.
+ */
 static void
-parse_location(xmlNode *cur_node,
-               xml_location *loc)
+parse_location_value(xml_location *loc,
+                     location_values value,
+                     PropFunc prop,
+                     gconstpointer source,
+                     const gchar *name)
 {
-    xmlNode *child_node;
+    gchar *str;
 
-    g_free(loc->altitude);
-    loc->altitude = PROP(cur_node, "altitude");
+    str = prop(source, name);
+    if (str && *str)
+        LOC_SET(loc, value, g_ascii_strtod(str, NULL));
+    else
+        LOC_UNSET(loc, value);
+    g_free(str);
+}
 
-    g_free(loc->latitude);
-    loc->latitude = PROP(cur_node, "latitude");
 
-    g_free(loc->longitude);
-    loc->longitude = PROP(cur_node, "longitude");
+static const gchar *
+parse_interned_string(PropFunc prop,
+                      gconstpointer source,
+                      const gchar *name)
+{
+    gchar *str;
+    const gchar *interned = NULL;
+
+    str = prop(source, name);
+    if (str)
+        interned = g_intern_string(str);
+    g_free(str);
+    return interned;
+}
 
-    for (child_node = cur_node->children; child_node;
-         child_node = child_node->next) {
-        if (NODE_IS_TYPE(child_node, "temperature")) {
-            g_free(loc->temperature_unit);
-            g_free(loc->temperature_value);
-            loc->temperature_unit = PROP(child_node, "unit");
-            loc->temperature_value = PROP(child_node, "value");
-        }
-        if (NODE_IS_TYPE(child_node, "windDirection")) {
-            g_free(loc->wind_dir_deg);
-            g_free(loc->wind_dir_name);
-            loc->wind_dir_deg = PROP(child_node, "deg");
-            loc->wind_dir_name = PROP(child_node, "name");
-        }
-        if (NODE_IS_TYPE(child_node, "windSpeed")) {
-            g_free(loc->wind_speed_mps);
-            g_free(loc->wind_speed_beaufort);
-            loc->wind_speed_mps = PROP(child_node, "mps");
-            loc->wind_speed_beaufort = PROP(child_node, "beaufort");
-        }
-        if (NODE_IS_TYPE(child_node, "humidity")) {
-            g_free(loc->humidity_unit);
-            g_free(loc->humidity_value);
-            loc->humidity_unit = PROP(child_node, "unit");
-            loc->humidity_value = PROP(child_node, "value");
-        }
-        if (NODE_IS_TYPE(child_node, "pressure")) {
-            g_free(loc->pressure_unit);
-            g_free(loc->pressure_value);
-            loc->pressure_unit = PROP(child_node, "unit");
-            loc->pressure_value = PROP(child_node, "value");
-        }
-        if (NODE_IS_TYPE(child_node, "cloudiness")) {
-            g_free(loc->clouds_percent[CLOUDS_PERC_CLOUDINESS]);
-            loc->clouds_percent[CLOUDS_PERC_CLOUDINESS] = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "fog")) {
-            g_free(loc->fog_percent);
-            loc->fog_percent = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "lowClouds")) {
-            g_free(loc->clouds_percent[CLOUDS_PERC_LOW]);
-            loc->clouds_percent[CLOUDS_PERC_LOW] = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "mediumClouds")) {
-            g_free(loc->clouds_percent[CLOUDS_PERC_MID]);
-            loc->clouds_percent[CLOUDS_PERC_MID] = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "highClouds")) {
-            g_free(loc->clouds_percent[CLOUDS_PERC_HIGH]);
-            loc->clouds_percent[CLOUDS_PERC_HIGH] = PROP(child_node, "percent");
-        }
-        if (NODE_IS_TYPE(child_node, "precipitation")) {
-            g_free(loc->precipitation_unit);
-            g_free(loc->precipitation_value);
-            loc->precipitation_unit = PROP(child_node, "unit");
-            loc->precipitation_value = PROP(child_node, "value");
-        }
-        if (NODE_IS_TYPE(child_node, "symbol")) {
-            g_free(loc->symbol);
-            loc->symbol_id = strtol(PROP(child_node, "number"), NULL, 10);
-            loc->symbol = g_strdup(get_symbol_for_id(loc->symbol_id));
-        }
+
+static void
+parse_location_attributes(xml_location *loc,
+                          PropFunc prop,
+                          gconstpointer source)
+{
+    parse_location_value(loc, LOC_ALTITUDE, prop, source, "altitude");
+    parse_location_value(loc, LOC_LATITUDE, prop, source, "latitude");
+    parse_location_value(loc, LOC_LONGITUDE, prop, source, "longitude");
+}
+
+
+static void
+parse_location_element(xml_location *loc,
+                       const xmlChar *name,
+                       PropFunc prop,
+                       gconstpointer source)
+{
+    gchar *number;
+
+    if (NAME_IS(name, "temperature")) {
+        loc->temperature_unit = parse_interned_string(prop, source, "unit");
+        parse_location_value(loc, LOC_TEMPERATURE, prop, source, "value");
+    }
+    if (NAME_IS(name, "windDirection")) {
+        parse_location_value(loc, LOC_WIND_DIR_DEG, prop, source, "deg");
+        loc->wind_dir_name = parse_interned_string(prop, source, "name");
+    }
+    if (NAME_IS(name, "windSpeed")) {
+        parse_location_value(loc, LOC_WIND_SPEED_MPS, prop, source, "mps");
+        parse_location_value(loc, LOC_WIND_SPEED_BEAUFORT,
+                             prop, source, "beaufort");
+    }
+    if (NAME_IS(name, "humidity")) {
+        loc->humidity_unit = parse_interned_string(prop, source, "unit");
+        parse_location_value(loc, LOC_HUMIDITY, prop, source, "value");
+    }
+    if (NAME_IS(name, "pressure")) {
+        loc->pressure_unit = parse_interned_string(prop, source, "unit");
+        parse_location_value(loc, LOC_PRESSURE, prop, source, "value");
     }
+    if (NAME_IS(name, "cloudiness"))
+        parse_location_value(loc, LOC_CLOUDINESS, prop, source, "percent");
+    if (NAME_IS(name, "fog"))
+        parse_location_value(loc, LOC_FOG, prop, source, "percent");
+    if (NAME_IS(name, "lowClouds"))
+        parse_location_value(loc, LOC_CLOUDS_LOW, prop, source, "percent");
+    if (NAME_IS(name, "mediumClouds"))
+        parse_location_value(loc, LOC_CLOUDS_MID, prop, source, "percent");
+    if (NAME_IS(name, "highClouds"))
+        parse_location_value(loc, LOC_CLOUDS_HIGH, prop, source, "percent");
+    if (NAME_IS(name, "precipitation")) {
+        loc->precipitation_unit = parse_interned_string(prop, source, "unit");
+        parse_location_value(loc, LOC_PRECIPITATION, prop, source, "value");
+    }
+    if (NAME_IS(name, "symbol")) {
+        number = prop(source, "number");
+        loc->symbol_id = number ? strtol(number, NULL, 10) : 0;
+        g_free(number);
+        loc->symbol = get_symbol_for_id(loc->symbol_id);
+    }
+}
+
 
-    /* Convert Fahrenheit to Celsius if necessary, so that we don't
-       have to do it later. met.no usually provides values in Celsius. */
-    if (loc->temperature_value && loc->temperature_unit &&
+/*
+ * Convert Fahrenheit to Celsius if necessary, so that we don't have
+ * to do it later. met.no usually provides values in Celsius.
+ */
+static void
+location_to_celsius(xml_location *loc)
+{
+    if (LOC_HAS(loc, LOC_TEMPERATURE) && loc->temperature_unit &&
         !strcmp(loc->temperature_unit, "fahrenheit")) {
-        gdouble val = string_to_double(loc->temperature_value, 0);
-        val = (val - 32.0) * 5.0 / 9.0;
-        g_free(loc->temperature_value);
-        loc->temperature_value = double_to_string(val, "%.1f");
-        g_free(loc->temperature_unit);
-        loc->temperature_unit = g_strdup("celsius");
+        loc->values[LOC_TEMPERATURE] =
+            (loc->values[LOC_TEMPERATURE] - 32.0) * 5.0 / 9.0;
+        loc->temperature_unit = g_intern_static_string("celsius");
     }
 }
 
 
+static void
+parse_location(xmlNode *cur_node,
+               xml_location *loc)
+{
+    xmlNode *child_node;
+
+    parse_location_attributes(loc, node_prop, cur_node);
+    for (child_node = cur_node->children; child_node;
+         child_node = child_node->next)
+        parse_location_element(loc, child_node->name, node_prop, child_node);
+    location_to_celsius(loc);
+}
+
+
 xml_weather *
 make_weather_data(void)
 {
@@ -318,6 +566,7 @@ make_weather_data(void)
         g_slice_free(xml_weather, wd);
         return NULL;
     }
+    wd->timeslice_index = g_hash_table_new(xml_time_hash, xml_time_equal);
     return wd;
 }
 
@@ -336,47 +585,81 @@ make_timeslice(void)
         g_slice_free(xml_time, timeslice);
         return NULL;
     }
+    weather_profile_alloc(2);
     return timeslice;
 }
 
 
-static void
-parse_time(xmlNode *cur_node,
-           xml_weather *wd)
+/*
+ * Read the interval of a forecast <time> element. Returns FALSE for
+ * other elements and invalid intervals.
+ */
+static gboolean
+parse_time_interval(PropFunc prop,
+                    gconstpointer source,
+                    time_t *start_t,
+                    time_t *end_t)
 {
     gchar *datatype, *from, *to;
-    time_t start_t, end_t;
-    xml_time *timeslice;
-    xmlNode *child_node;
 
-    datatype = PROP(cur_node, "datatype");
+    datatype = prop(source, "datatype");
     if (xmlStrcasecmp((xmlChar *) datatype, (xmlChar *) "forecast")) {
-        xmlFree(datatype);
-        return;
+        g_free(datatype);
+        return FALSE;
     }
-    xmlFree(datatype);
+    g_free(datatype);
 
-    from = PROP(cur_node, "from");
-    start_t = parse_timestring(from, NULL, FALSE);
-    xmlFree(from);
+    from = prop(source, "from");
+    *start_t = parse_timestring(from, NULL, FALSE);
+    g_free(from);
 
-    to = PROP(cur_node, "to");
-    end_t = parse_timestring(to, NULL, FALSE);
-    xmlFree(to);
+    to = prop(source, "to");
+    *end_t = parse_timestring(to, NULL, FALSE);
+    g_free(to);
+
+    return (*start_t && *end_t);
+}
 
-    if (G_UNLIKELY(!start_t || !end_t))
-        return;
+
+/*
+ * Find the timeslice a forecast <time> element refers to, or add a new
+ * one if it is not yet known.
+ */
+static xml_time *
+get_or_add_timeslice(xml_weather *wd,
+                     PropFunc prop,
+                     gconstpointer source)
+{
+    time_t start_t, end_t;
+    xml_time *timeslice;
+
+    if (G_UNLIKELY(!parse_time_interval(prop, source, &start_t, &end_t)))
+        return NULL;
 
     /* look for existing timeslice or add a new one */
-    timeslice = get_timeslice(wd, start_t, end_t, NULL);
+    timeslice = get_timeslice(wd, start_t, end_t);
     if (! timeslice) {
         timeslice = make_timeslice();
         if (G_UNLIKELY(!timeslice))
-            return;
+            return NULL;
         timeslice->start = start_t;
         timeslice->end = end_t;
-        g_array_append_val(wd->timeslices, timeslice);
+        xml_weather_add_timeslice(wd, timeslice);
     }
+    return timeslice;
+}
+
+
+static void
+parse_time(xmlNode *cur_node,
+           xml_weather *wd)
+{
+    xml_time *timeslice;
+    xmlNode *child_node;
+
+    timeslice = get_or_add_timeslice(wd, node_prop, cur_node);
+    if (G_UNLIKELY(timeslice == NULL))
+        return;
 
     for (child_node = cur_node->children; child_node;
          child_node = child_node->next)
@@ -418,10 +701,262 @@ parse_weather(xmlNode *cur_node,
                     parse_time(child_node, wd);
         }
     }
+
+    /* existing timeslices may have been updated in place */
+    xml_weather_invalidate(wd);
     return TRUE;
 }
 
 
+/*
+ * State of the streaming weather data parser. Element depths are
+ * remembered so that only the same elements are handled as by
+ * parse_weather, which walks the DOM tree. Each <time> element is
+ * read into the private timeslice, which is only merged into wd when
+ * the element is complete, as the main loop may read wd between two
+ * chunks of the document.
+ */
+typedef struct {
+    xml_weather *wd;
+    xml_time *timeslice;
+    gboolean root_found;
+    gint depth;
+    gint product_depth;
+    gint time_depth;
+    gint location_depth;
+} weather_sax_state;
+
+
+static void
+weather_sax_start_element(void *ctx,
+                          const xmlChar *localname,
+                          const xmlChar *prefix,
+                          const xmlChar *uri,
+                          int nb_namespaces,
+                          const xmlChar **namespaces,
+                          int nb_attributes,
+                          int nb_defaulted,
+                          const xmlChar **attributes)
+{
+    weather_sax_state *state = ctx;
+    sax_attributes attrs = { nb_attributes, attributes };
+    time_t start_t, end_t;
+    gchar *class;
+
+    state->depth++;
+
+    if (state->depth == 1) {
+        state->root_found = NAME_IS(localname, "weatherdata");
+        return;
+    }
+    if (G_UNLIKELY(!state->root_found))
+        return;
+
+    if (state->depth == 2) {
+        if (NAME_IS(localname, "product")) {
+            class = sax_prop(&attrs, "class");
+            if (!xmlStrcasecmp((xmlChar *) class, (xmlChar *) "pointData"))
+                state->product_depth = state->depth;
+            g_free(class);
+        }
+    } else if (state->product_depth &&
+               state->depth == state->product_depth + 1) {
+        if (NAME_IS(localname, "time") &&
+            parse_time_interval(sax_prop, &attrs, &start_t, &end_t)) {
+            /* reuse the private timeslice for every element */
+            if (state->timeslice == NULL)
+                state->timeslice = make_timeslice();
+            else
+                memset(state->timeslice->location, 0, sizeof(xml_location));
+            state->timeslice->start = start_t;
+            state->timeslice->end = end_t;
+            state->time_depth = state->depth;
+        }
+    } else if (state->time_depth &&
+               state->depth == state->time_depth + 1) {
+        if (G_LIKELY(NAME_IS(localname, "location"))) {
+            parse_location_attributes(state->timeslice->location,
+                                      sax_prop, &attrs);
+            state->location_depth = state->depth;
+        }
+    } else if (state->location_depth &&
+               state->depth == state->location_depth + 1)
+        parse_location_element(state->timeslice->location, localname,
+                               sax_prop, &attrs);
+}
+
+
+static void
+weather_sax_end_element(void *ctx,
+                        const xmlChar *localname,
+                        const xmlChar *prefix,
+                        const xmlChar *uri)
+{
+    weather_sax_state *state = ctx;
+
+    if (state->depth == state->location_depth) {
+        location_to_celsius(state->timeslice->location);
+        state->location_depth = 0;
+    } else if (state->depth == state->time_depth) {
+        merge_timeslice(state->wd, state->timeslice);
+        state->time_depth = 0;
+    } else if (state->depth == state->product_depth)
+        state->product_depth = 0;
+    state->depth--;
+}
+
+
+struct _xml_weather_parser {
+    xmlParserCtxtPtr ctxt;
+    weather_sax_state state;
+    gsize bytes;
+};
+
+
+/*
+ * Create a push parser that merges weather data into wd while the
+ * document is fed to it chunk by chunk. If encoding is not NULL, it
+ * overrides the encoding declared in the XML header.
+ */
+xml_weather_parser *
+xml_weather_parser_new(xml_weather *wd,
+                       const gchar *encoding)
+{
+    xml_weather_parser *parser;
+    xmlSAXHandler sax;
+
+    g_assert(wd != NULL);
+    if (G_UNLIKELY(wd == NULL))
+        return NULL;
+
+    parser = g_slice_new0(xml_weather_parser);
+    if (G_UNLIKELY(parser == NULL))
+        return NULL;
+    parser->state.wd = wd;
+
+    /* libxml2 makes its own copy of the handler */
+    memset(&sax, 0, sizeof(xmlSAXHandler));
+    sax.initialized = XML_SAX2_MAGIC;
+    sax.startElementNs = weather_sax_start_element;
+    sax.endElementNs = weather_sax_end_element;
+
+    parser->ctxt = xmlCreatePushParserCtxt(&sax, &parser->state,
+                                           NULL, 0, NULL);
+    if (G_UNLIKELY(parser->ctxt == NULL)) {
+        g_slice_free(xml_weather_parser, parser);
+        return NULL;
+    }
+    if (encoding)
+        xmlCtxtResetPush(parser->ctxt, NULL, 0, NULL, encoding);
+    return parser;
+}
+
+
+/*
+ * Feed the next chunk of the document to the parser. Returns FALSE
+ * as soon as the document turns out not to be well-formed.
+ */
+gboolean
+xml_weather_parser_feed(xml_weather_parser *parser,
+                        const gchar *chunk,
+                        gsize len)
+{
+    profile_mark mark;
+    gboolean result;
+
+    g_assert(parser != NULL);
+    if (G_UNLIKELY(parser == NULL))
+        return FALSE;
+
+    if (G_UNLIKELY(!parser->ctxt->wellFormed))
+        return FALSE;
+    if (G_UNLIKELY(chunk == NULL || len == 0))
+        return TRUE;
+
+    parser->bytes += len;
+    weather_profile_begin(&mark);
+    result = xmlParseChunk(parser->ctxt, chunk, len, 0) == 0;
+    weather_profile_end(PROFILE_PARSE, &mark);
+    return result;
+}
+
+
+/*
+ * Terminate parsing and free the parser. Returns TRUE if a complete,
+ * well-formed weather document has been parsed.
+ */
+gboolean
+xml_weather_parser_finish(xml_weather_parser *parser)
+{
+    gboolean success;
+
+    g_assert(parser != NULL);
+    if (G_UNLIKELY(parser == NULL))
+        return FALSE;
+
+    xmlParseChunk(parser->ctxt, NULL, 0, 1);
+    success = parser->ctxt->wellFormed && parser->state.root_found;
+    weather_debug("Parsed %" G_GSIZE_FORMAT " bytes of weather data, "
+                  "well-formed: %d, root found: %d.", parser->bytes,
+                  parser->ctxt->wellFormed, parser->state.root_found);
+    xml_weather_parser_free(parser);
+    return success;
+}
+
+
+/*
+ * Free the parser without terminating the document, for example when
+ * a download has been aborted or has failed.
+ *
+ * Unlike with parse_weather, the data of an incomplete document is
+ * not discarded: every complete <time> element has been merged into
+ * wd already, and is a valid forecast for its interval, just like
+ * timeslices merged from the cache file. An element that has not been
+ * read completely is never merged.
+ */
+void
+xml_weather_parser_free(xml_weather_parser *parser)
+{
+    g_assert(parser != NULL);
+    if (G_UNLIKELY(parser == NULL))
+        return;
+
+    if (parser->state.timeslice)
+        xml_time_free(parser->state.timeslice);
+    xmlFreeParserCtxt(parser->ctxt);
+    g_slice_free(xml_weather_parser, parser);
+}
+
+
+/*
+ * Parse XML weather data from a buffer and merge it with current
+ * data. Unlike parse_weather, this does not build a DOM tree, but
+ * fills in the timeslices while the document is being read.
+ */
+gboolean
+parse_weather_buffer(const gchar *buffer,
+                     gsize len,
+                     xml_weather *wd)
+{
+    xml_weather_parser *parser;
+    const gchar *encoding = NULL;
+
+    g_assert(wd != NULL);
+    if (G_UNLIKELY(wd == NULL || buffer == NULL))
+        return FALSE;
+
+    /* force parsing as UTF-8, the XML encoding header may lie */
+    if (g_utf8_validate(buffer, len, NULL))
+        encoding = "UTF-8";
+
+    parser = xml_weather_parser_new(wd, encoding);
+    if (G_UNLIKELY(parser == NULL))
+        return FALSE;
+    xml_weather_parser_feed(parser, buffer, len);
+    return xml_weather_parser_finish(parser);
+}
+
+
 static xml_astro *
 parse_astro_time(xmlNode *cur_node)
 {
@@ -694,27 +1229,6 @@ xml_location_free(xml_location *loc)
     g_assert(loc != NULL);
     if (G_UNLIKELY(loc == NULL))
         return;
-    g_free(loc->altitude);
-    g_free(loc->latitude);
-    g_free(loc->longitude);
-    g_free(loc->temperature_value);
-    g_free(loc->temperature_unit);
-    g_free(loc->wind_dir_deg);
-    g_free(loc->wind_dir_name);
-    g_free(loc->wind_speed_mps);
-    g_free(loc->wind_speed_beaufort);
-    g_free(loc->humidity_value);
-    g_free(loc->humidity_unit);
-    g_free(loc->pressure_value);
-    g_free(loc->pressure_unit);
-    g_free(loc->clouds_percent[CLOUDS_PERC_LOW]);
-    g_free(loc->clouds_percent[CLOUDS_PERC_MID]);
-    g_free(loc->clouds_percent[CLOUDS_PERC_HIGH]);
-    g_free(loc->clouds_percent[CLOUDS_PERC_CLOUDINESS]);
-    g_free(loc->fog_percent);
-    g_free(loc->precipitation_value);
-    g_free(loc->precipitation_unit);
-    g_free(loc->symbol);
     g_slice_free(xml_location, loc);
 }
 
@@ -759,7 +1273,6 @@ xml_time_copy(const xml_time *src)
 {
     xml_time *dst;
     xml_location *loc;
-    gint i;
 
     if (G_UNLIKELY(src == NULL))
         return NULL;
@@ -778,38 +1291,13 @@ xml_time_copy(const xml_time *src)
 
     dst->start = src->start;
     dst->end = src->end;
+    dst->point = src->point;
 
-    loc->altitude = g_strdup(src->location->altitude);
-    loc->latitude = g_strdup(src->location->latitude);
-    loc->longitude = g_strdup(src->location->longitude);
-
-    loc->temperature_value = g_strdup(src->location->temperature_value);
-    loc->temperature_unit = g_strdup(src->location->temperature_unit);
-
-    loc->wind_dir_deg = g_strdup(src->location->wind_dir_deg);
-    loc->wind_dir_name = g_strdup(src->location->wind_dir_name);
-    loc->wind_speed_mps = g_strdup(src->location->wind_speed_mps);
-    loc->wind_speed_beaufort = g_strdup(src->location->wind_speed_beaufort);
-
-    loc->humidity_value = g_strdup(src->location->humidity_value);
-    loc->humidity_unit = g_strdup(src->location->humidity_unit);
-
-    loc->pressure_value = g_strdup(src->location->pressure_value);
-    loc->pressure_unit = g_strdup(src->location->pressure_unit);
-
-    for (i = 0; i < CLOUDS_PERC_NUM; i++)
-        loc->clouds_percent[i] = g_strdup(src->location->clouds_percent[i]);
-
-    loc->fog_percent = g_strdup(src->location->fog_percent);
-
-    loc->precipitation_value =
-        g_strdup(src->location->precipitation_value);
-    loc->precipitation_unit = g_strdup(src->location->precipitation_unit);
-
-    loc->symbol_id = src->location->symbol_id;
-    loc->symbol = g_strdup(src->location->symbol);
+    /* all strings are interned, so a flat copy is enough */
+    *loc = *src->location;
 
     dst->location = loc;
+    weather_profile_alloc(2);
 
     return dst;
 }
@@ -843,6 +1331,9 @@ xml_weather_free(xml_weather *wd)
         }
         g_array_free(wd->timeslices, FALSE);
     }
+    if (G_LIKELY(wd->timeslice_index))
+        g_hash_table_destroy(wd->timeslice_index);
+    xml_time_columns_free(wd->columns);
     if (G_LIKELY(wd->current_conditions)) {
         weather_debug("Freeing current conditions.");
         xml_time_free(wd->current_conditions);
@@ -851,27 +1342,40 @@ xml_weather_free(xml_weather *wd)
 }
 
 
+/*
+ * Remove expired timeslices, compacting the remaining ones in a
+ * single pass over the array.
+ */
 void
 xml_weather_clean(xml_weather *wd)
 {
     xml_time *timeslice;
     time_t now_t = time(NULL);
-    guint i;
+    profile_mark mark;
+    guint i, j;
 
     if (G_UNLIKELY(wd == NULL || wd->timeslices == NULL))
         return;
-    for (i = 0; i < wd->timeslices->len; i++) {
+
+    weather_profile_begin(&mark);
+    for (i = 0, j = 0; i < wd->timeslices->len; i++) {
         timeslice = g_array_index(wd->timeslices, xml_time *, i);
-        if (G_UNLIKELY(timeslice == NULL))
-            continue;
-        if (difftime(now_t, timeslice->end) > DATA_EXPIRY_TIME) {
+        if (G_LIKELY(timeslice) &&
+            difftime(now_t, timeslice->end) > DATA_EXPIRY_TIME) {
             weather_debug("Removing expired timeslice:");
             weather_dump(weather_dump_timeslice, timeslice);
+            g_hash_table_remove(wd->timeslice_index, timeslice);
             xml_time_free(timeslice);
-            g_array_remove_index(wd->timeslices, i--);
-            weather_debug("Remaining timeslices: %d", wd->timeslices->len);
+            continue;
         }
+        g_array_index(wd->timeslices, xml_time *, j++) = timeslice;
+    }
+    if (j < wd->timeslices->len) {
+        g_array_set_size(wd->timeslices, j);
+        xml_weather_invalidate(wd);
+        weather_debug("Remaining timeslices: %d", wd->timeslices->len);
     }
+    weather_profile_end(PROFILE_CLEAN, &mark);
 }
 
 
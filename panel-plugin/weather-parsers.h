@@ -28,43 +28,61 @@
 
 G_BEGIN_DECLS
 
-enum {
-    CLOUDS_PERC_LOW = 0,
-    CLOUDS_PERC_MID,
-    CLOUDS_PERC_HIGH,
-    CLOUDS_PERC_CLOUDINESS,
-    CLOUDS_PERC_NUM
-};
+/* numeric values of xml_location, see LOC_HAS and LOC_SET */
+typedef enum {
+    LOC_ALTITUDE = 0,
+    LOC_LATITUDE,
+    LOC_LONGITUDE,
+    LOC_TEMPERATURE,
+    LOC_WIND_DIR_DEG,
+    LOC_WIND_SPEED_MPS,
+    LOC_WIND_SPEED_BEAUFORT,
+    LOC_HUMIDITY,
+    LOC_PRESSURE,
+    LOC_CLOUDS_LOW,
+    LOC_CLOUDS_MID,
+    LOC_CLOUDS_HIGH,
+    LOC_CLOUDINESS,
+    LOC_FOG,
+    LOC_PRECIPITATION,
+    LOC_VALUES_NUM
+} location_values;
+
+#define LOC_HAS(loc, value)                     \
+    (((loc)->valid & (1u << (value))) != 0)
+
+#define LOC_SET(loc, value, val)                \
+    do {                                        \
+        (loc)->values[value] = (val);           \
+        (loc)->valid |= 1u << (value);          \
+    } while (0)
+
+#define LOC_UNSET(loc, value)                   \
+    do {                                        \
+        (loc)->values[value] = 0;               \
+        (loc)->valid &= ~(1u << (value));       \
+    } while (0)
 
 typedef gpointer (*XmlParseFunc) (xmlNode *node);
 
-typedef struct {
-    gchar *altitude;
-    gchar *latitude;
-    gchar *longitude;
-
-    gchar *temperature_value;
-    gchar *temperature_unit;
-
-    gchar *wind_dir_deg;
-    gchar *wind_dir_name;
-    gchar *wind_speed_mps;
-    gchar *wind_speed_beaufort;
+typedef struct _xml_weather_parser xml_weather_parser;
 
-    gchar *humidity_value;
-    gchar *humidity_unit;
-
-    gchar *pressure_value;
-    gchar *pressure_unit;
-
-    gchar *clouds_percent[CLOUDS_PERC_NUM];
-    gchar *fog_percent;
+/*
+ * Values that are not set are 0 and have their bit cleared in
+ * valid. All strings are interned or static and must not be freed.
+ */
+typedef struct {
+    gdouble values[LOC_VALUES_NUM];
+    guint32 valid;
 
-    gchar *precipitation_value;
-    gchar *precipitation_unit;
+    const gchar *temperature_unit;
+    const gchar *wind_dir_name;
+    const gchar *humidity_unit;
+    const gchar *pressure_unit;
+    const gchar *precipitation_unit;
 
     gint symbol_id;
-    gchar *symbol;
+    const gchar *symbol;
 } xml_location;
 
 typedef struct {
@@ -74,8 +92,26 @@ typedef struct {
     xml_location *location;
 } xml_time;
 
+/*
+ * Columnar view of the timeslices, sorted by start and end time, so
+ * that searches only need to walk over plain time arrays. by_end
+ * holds the same timeslices sorted by end and start time. It is built
+ * on demand by xml_weather_get_columns() and dropped whenever the
+ * timeslices change.
+ */
+typedef struct {
+    guint len;
+    time_t *start;
+    time_t *end;
+    gboolean *interval;
+    xml_time **timeslices;
+    xml_time **by_end;
+} xml_time_columns;
+
 typedef struct {
     GArray *timeslices;
+    GHashTable *timeslice_index;    /* (start, end) -> xml_time */
+    xml_time_columns *columns;      /* NULL if outdated */
     xml_time *current_conditions;
 } xml_weather;
 
@@ -133,6 +169,21 @@ time_t parse_timestring(const gchar *ts,
 gboolean parse_weather(xmlNode *cur_node,
                        xml_weather *wd);
 
+gboolean parse_weather_buffer(const gchar *buffer,
+                              gsize len,
+                              xml_weather *wd);
+
+xml_weather_parser *xml_weather_parser_new(xml_weather *wd,
+                                           const gchar *encoding);
+
+gboolean xml_weather_parser_feed(xml_weather_parser *parser,
+                                 const gchar *chunk,
+                                 gsize len);
+
+gboolean xml_weather_parser_finish(xml_weather_parser *parser);
+
+void xml_weather_parser_free(xml_weather_parser *parser);
+
 xml_astro *parse_astro(xmlNode *cur_node);
 
 gboolean parse_astrodata(xmlNode *cur_node,
@@ -148,8 +199,20 @@ xml_timezone *parse_timezone(xmlNode *cur_node);
 
 xml_time *get_timeslice(xml_weather *wd,
                         const time_t start_t,
-                        const time_t end_t,
-                        guint *index);
+                        const time_t end_t);
+
+void xml_weather_add_timeslice(xml_weather *wd,
+                               xml_time *timeslice);
+
+const xml_time_columns *xml_weather_get_columns(xml_weather *wd);
+
+guint xml_time_columns_search(const xml_time_columns *columns,
+                              const time_t start_t);
+
+guint xml_time_columns_search_end(const xml_time_columns *columns,
+                                  const time_t end_t);
+
+void xml_weather_invalidate(xml_weather *wd);
 
 xml_astro *get_astro(const GArray *astrodata,
                      const time_t day_t,
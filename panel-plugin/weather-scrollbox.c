@@ -30,10 +30,22 @@
 
 #define LABEL_SLEEP (3)       /* sleep time in seconds */
 #define LABEL_SLEEP_LONG (6)  /* sleep time in seconds for FADE_NONE */
-#define LABEL_SPEED (25)      /* animation speed, delay in ms */
+#define LABEL_DURATION (500)  /* default fade in/out duration in ms */
 #define LABEL_PADDING (3)     /* padding to left/right or top/bottom of label */
 
 
+/* a label rendered for drawing, attached to its layout */
+typedef struct {
+    cairo_surface_t *surface;
+    PangoRectangle logical_rect;  /* of the unrotated layout */
+    PangoRectangle bounds;        /* of the rotated layout, in pixels */
+    gint scale;
+} label_surface;
+
+static GQuark label_surface_quark;
+static GQuark label_markup_quark;
+
+
 static void gtk_scrollbox_finalize(GObject *object);
 
 static void gtk_scrollbox_get_preferred_height (GtkWidget *widget,
@@ -47,8 +59,17 @@ static void gtk_scrollbox_get_preferred_width (GtkWidget *widget,
 static gboolean gtk_scrollbox_draw_event(GtkWidget *widget,
                                          cairo_t   *cr);
 
+static void gtk_scrollbox_style_updated(GtkWidget *widget);
+
+static void gtk_scrollbox_map(GtkWidget *widget);
+
+static void gtk_scrollbox_unmap(GtkWidget *widget);
+
 static gboolean gtk_scrollbox_control_loop(gpointer user_data);
 
+static void gtk_scrollbox_size_request(GtkWidget *widget,
+                                       GtkRequisition *requisition);
+
 G_DEFINE_TYPE(GtkScrollbox, gtk_scrollbox, GTK_TYPE_DRAWING_AREA)
 
 
@@ -65,6 +86,14 @@ gtk_scrollbox_class_init(GtkScrollboxClass *klass)
     widget_class->get_preferred_width = gtk_scrollbox_get_preferred_width;
     widget_class->get_preferred_height = gtk_scrollbox_get_preferred_height;
     widget_class->draw = gtk_scrollbox_draw_event;
+    widget_class->style_updated = gtk_scrollbox_style_updated;
+    widget_class->map = gtk_scrollbox_map;
+    widget_class->unmap = gtk_scrollbox_unmap;
+
+    label_surface_quark =
+        g_quark_from_static_string("gtk-scrollbox-label-surface");
+    label_markup_quark =
+        g_quark_from_static_string("gtk-scrollbox-label-markup");
 }
 
 
@@ -76,6 +105,14 @@ gtk_scrollbox_init(GtkScrollbox *self)
     self->labels = NULL;
     self->labels_new = NULL;
     self->timeout_id = 0;
+    self->tick_id = 0;
+    self->duration = LABEL_DURATION;
+    self->max_fps = 0;
+    self->suspended = FALSE;
+    self->paused = FALSE;
+    self->paused_since = 0;
+    self->skipped_frames = 0;
+    self->paused_frames = 0;
     self->labels_len = 0;
     self->offset = 0;
     self->fade = FADE_OUT;
@@ -88,6 +125,78 @@ gtk_scrollbox_init(GtkScrollbox *self)
 }
 
 
+static void
+label_surface_free(gpointer user_data)
+{
+    label_surface *label = user_data;
+
+    cairo_surface_destroy(label->surface);
+    g_slice_free(label_surface, label);
+}
+
+
+/*
+ * Forget the rendered labels, needed whenever their appearance
+ * changes.
+ */
+static void
+gtk_scrollbox_clear_surfaces(GtkScrollbox *self)
+{
+    GList *li;
+
+    for (li = self->labels; li != NULL; li = li->next)
+        g_object_set_qdata(G_OBJECT(li->data), label_surface_quark, NULL);
+}
+
+
+/*
+ * Render a label into a surface once, so that drawing it during
+ * animations is only a matter of painting the surface at an offset.
+ */
+static label_surface *
+gtk_scrollbox_render_label(GtkScrollbox *self,
+                           PangoLayout *layout)
+{
+    label_surface *label;
+    PangoMatrix matrix = PANGO_MATRIX_INIT;
+    cairo_t *cr;
+    gint scale;
+
+    scale = gtk_widget_get_scale_factor(GTK_WIDGET(self));
+    label = g_object_get_qdata(G_OBJECT(layout), label_surface_quark);
+    if (label && label->scale == scale)
+        return label;
+
+    label = g_slice_new0(label_surface);
+    label->scale = scale;
+
+    pango_matrix_rotate(&matrix,
+                        (self->orientation == GTK_ORIENTATION_HORIZONTAL)
+                        ? 0.0 : -90.0);
+    pango_context_set_matrix(pango_layout_get_context(layout), &matrix);
+    pango_layout_context_changed(layout);
+    pango_layout_get_extents(layout, NULL, &label->logical_rect);
+
+    label->bounds = label->logical_rect;
+    pango_extents_to_pixels(&label->bounds, NULL);
+    pango_matrix_transform_pixel_rectangle(&matrix, &label->bounds);
+
+    label->surface =
+        cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+                                   MAX(label->bounds.width, 1) * scale,
+                                   MAX(label->bounds.height, 1) * scale);
+    cairo_surface_set_device_scale(label->surface, scale, scale);
+    cr = cairo_create(label->surface);
+    gtk_render_layout(gtk_widget_get_style_context(GTK_WIDGET(self)),
+                      cr, -label->bounds.x, -label->bounds.y, layout);
+    cairo_destroy(cr);
+
+    g_object_set_qdata_full(G_OBJECT(layout), label_surface_quark,
+                            label, label_surface_free);
+    return label;
+}
+
+
 static void
 gtk_scrollbox_labels_free(GtkScrollbox *self)
 {
@@ -97,14 +206,49 @@ gtk_scrollbox_labels_free(GtkScrollbox *self)
 }
 
 
+/*
+ * Stop the sleep timeout or animation that is currently running.
+ */
+static void
+gtk_scrollbox_stop(GtkScrollbox *self)
+{
+    if (self->timeout_id != 0) {
+        g_source_remove(self->timeout_id);
+        self->timeout_id = 0;
+    }
+    if (self->tick_id != 0) {
+        gtk_widget_remove_tick_callback(GTK_WIDGET(self), self->tick_id);
+        self->tick_id = 0;
+    }
+}
+
+
+/*
+ * Queue a resize only if the extents of the labels have changed, as
+ * this causes the whole panel to be laid out again.
+ */
+static void
+gtk_scrollbox_queue_resize(GtkScrollbox *self)
+{
+    GtkRequisition requisition;
+
+    gtk_scrollbox_size_request(GTK_WIDGET(self), &requisition);
+    if (requisition.width == self->requisition.width &&
+        requisition.height == self->requisition.height)
+        return;
+
+    self->requisition = requisition;
+    gtk_widget_queue_resize(GTK_WIDGET(self));
+}
+
+
 static void
 gtk_scrollbox_finalize(GObject *object)
 {
     GtkScrollbox *self = GTK_SCROLLBOX(object);
 
-    /* stop running timeout */
-    if (self->timeout_id != 0)
-        g_source_remove(self->timeout_id);
+    /* stop running timeout or animation */
+    gtk_scrollbox_stop(self);
 
     /* free all the labels */
     gtk_scrollbox_labels_free(self);
@@ -134,13 +278,15 @@ gtk_scrollbox_set_font(GtkScrollbox *self,
         pango_layout_set_font_description(layout, desc);
         pango_layout_set_attributes(layout, self->pattr_list);
         pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
-    } else
+    } else {
+        gtk_scrollbox_clear_surfaces(self);
         for (li = self->labels; li != NULL; li = li->next) {
             layout = PANGO_LAYOUT(li->data);
             pango_layout_set_font_description(layout, desc);
             pango_layout_set_attributes(layout, self->pattr_list);
             pango_layout_set_alignment(layout, PANGO_ALIGN_CENTER);
         }
+    }
     pango_font_description_free(desc);
 }
 
@@ -215,11 +361,9 @@ gtk_scrollbox_draw_event(GtkWidget *widget,
                          cairo_t   *cr)
 {
     GtkScrollbox *self = GTK_SCROLLBOX(widget);
-    PangoLayout *layout;
+    label_surface *label;
     gint height, width;
-    PangoRectangle logical_rect;
     gboolean result = FALSE;
-    PangoMatrix matrix = PANGO_MATRIX_INIT;
     GtkAllocation allocation;
 
     if (GTK_WIDGET_CLASS(gtk_scrollbox_parent_class)->draw != NULL)
@@ -227,53 +371,92 @@ gtk_scrollbox_draw_event(GtkWidget *widget,
             (gtk_scrollbox_parent_class)->draw(widget, cr);
 
     if (self->active != NULL) {
-        layout = PANGO_LAYOUT(self->active->data);
-        pango_matrix_rotate(&matrix,
-                            (self->orientation == GTK_ORIENTATION_HORIZONTAL)
-                            ? 0.0 : -90.0);
-        pango_context_set_matrix(pango_layout_get_context(layout), &matrix);
-        pango_layout_get_extents(layout, NULL, &logical_rect);
+        label = gtk_scrollbox_render_label(self,
+                                           PANGO_LAYOUT(self->active->data));
 
         gtk_widget_get_allocation (GTK_WIDGET (widget), &allocation);
 
         if (self->orientation == GTK_ORIENTATION_HORIZONTAL) {
             width = LABEL_PADDING;
-            height = (allocation.height - PANGO_PIXELS(logical_rect.height)) / 2
+            height = (allocation.height
+                      - PANGO_PIXELS(label->logical_rect.height)) / 2
                 + (self->fade == FADE_IN || self->fade == FADE_OUT
                    ? self->offset : 0);
         } else {
             height = LABEL_PADDING;
-            width = (allocation.width + PANGO_PIXELS(logical_rect.height)) / 2
+            width = (allocation.width
+                     + PANGO_PIXELS(label->logical_rect.height)) / 2
                 + (self->fade == FADE_IN || self->fade == FADE_OUT
                    ? self->offset : 0);
         }
 
-        gtk_render_layout (gtk_widget_get_style_context (GTK_WIDGET (widget)),
-                           cr,
-                           width,
-                           height,
-                           layout);
+        cairo_set_source_surface(cr, label->surface,
+                                 width + label->bounds.x,
+                                 height + label->bounds.y);
+        cairo_paint(cr);
     }
     return result;
 }
 
 
+static void
+gtk_scrollbox_style_updated(GtkWidget *widget)
+{
+    GtkScrollbox *self = GTK_SCROLLBOX(widget);
+
+    GTK_WIDGET_CLASS(gtk_scrollbox_parent_class)->style_updated(widget);
+
+    /* colors from the theme are rendered into the labels */
+    gtk_scrollbox_clear_surfaces(self);
+}
+
+
 void
 gtk_scrollbox_add_label(GtkScrollbox *self,
                         const gint position,
                         const gchar *markup)
 {
-    PangoLayout *layout;
+    PangoLayout *layout = NULL;
+    GList *li;
 
     g_return_if_fail(GTK_IS_SCROLLBOX(self));
 
-    layout = gtk_widget_create_pango_layout(GTK_WIDGET(self), NULL);
-    pango_layout_set_markup(layout, markup, -1);
-    gtk_scrollbox_set_font(self, layout);
+    /* reuse the active label at the same position if it is unchanged,
+       saving the layout and its rendered surface */
+    li = g_list_nth(self->labels, (position < 0)
+                    ? g_list_length(self->labels_new) : (guint) position);
+    if (li && !g_strcmp0(markup, g_object_get_qdata(G_OBJECT(li->data),
+                                                     label_markup_quark)))
+        layout = g_object_ref(PANGO_LAYOUT(li->data));
+
+    if (layout == NULL) {
+        layout = gtk_widget_create_pango_layout(GTK_WIDGET(self), NULL);
+        pango_layout_set_markup(layout, markup, -1);
+        g_object_set_qdata_full(G_OBJECT(layout), label_markup_quark,
+                                g_strdup(markup), g_free);
+        gtk_scrollbox_set_font(self, layout);
+    }
     self->labels_new = g_list_insert(self->labels_new, layout, position);
 }
 
 
+/*
+ * Whether the new labels are exactly the active ones.
+ */
+static gboolean
+gtk_scrollbox_labels_unchanged(GtkScrollbox *self)
+{
+    GList *li, *li_new;
+
+    for (li = self->labels, li_new = self->labels_new;
+         li != NULL && li_new != NULL;
+         li = li->next, li_new = li_new->next)
+        if (li->data != li_new->data)
+            return FALSE;
+    return (li == NULL && li_new == NULL);
+}
+
+
 /*
  * Sets new labels active if there are any, or advances the current
  * label.
@@ -291,6 +474,13 @@ gtk_scrollbox_swap_labels(GtkScrollbox *self)
         return;
     }
 
+    /* Nothing changed, so keep the labels and just switch too */
+    if (gtk_scrollbox_labels_unchanged(self)) {
+        gtk_scrollbox_clear_new(self);
+        gtk_scrollbox_next_label(self);
+        return;
+    }
+
     /* Keep current list position if possible */
     if (self->active && self->labels_len > 1)
         pos = g_list_position(self->labels, self->active);
@@ -309,55 +499,72 @@ gtk_scrollbox_swap_labels(GtkScrollbox *self)
     self->labels = self->labels_new;
     self->labels_new = NULL;
 
-    gtk_widget_queue_resize(GTK_WIDGET(self));
+    gtk_scrollbox_queue_resize(self);
+    gtk_widget_queue_draw(GTK_WIDGET(self));
 }
 
 
+/*
+ * Move the label for a frame of a fade in or out. The offset is
+ * interpolated from the frame time, so the animation takes the same
+ * time regardless of the frame rate.
+ */
 static gboolean
-gtk_scrollbox_fade_in(gpointer user_data)
+gtk_scrollbox_tick(GtkWidget *widget,
+                   GdkFrameClock *frame_clock,
+                   gpointer user_data)
 {
-    GtkScrollbox *self = GTK_SCROLLBOX(user_data);
+    GtkScrollbox *self = GTK_SCROLLBOX(widget);
+    gint64 now;
+    gdouble progress;
 
-    /* decrease counter */
-    if (self->orientation == GTK_ORIENTATION_HORIZONTAL)
-        self->offset--;
-    else
-        self->offset++;
+    now = gdk_frame_clock_get_frame_time(frame_clock);
+    if (self->fade_start == 0)
+        self->fade_start = now;
 
-    gtk_widget_queue_draw(GTK_WIDGET(self));
+    if (self->duration == 0 || self->fade_from == self->fade_to)
+        progress = 1.0;
+    else
+        progress = (gdouble) (now - self->fade_start)
+            / (self->duration * G_GINT64_CONSTANT(1000));
+
+    if (progress >= 1.0) {
+        self->offset = self->fade_to;
+        self->tick_id = 0;
+        gtk_widget_queue_draw(widget);
+        (void) gtk_scrollbox_control_loop(self);
+        return G_SOURCE_REMOVE;
+    }
 
-    if ((self->orientation == GTK_ORIENTATION_HORIZONTAL && self->offset > 0) ||
-        (self->orientation == GTK_ORIENTATION_VERTICAL && self->offset < 0))
-        return TRUE;
+    /* skip frames exceeding the frame rate limit */
+    if (self->max_fps > 0 &&
+        now - self->last_frame < G_USEC_PER_SEC / self->max_fps) {
+        self->skipped_frames++;
+        return G_SOURCE_CONTINUE;
+    }
 
-    (void) gtk_scrollbox_control_loop(self);
-    return FALSE;
+    self->last_frame = now;
+    self->offset = self->fade_from
+        + (gint) ((self->fade_to - self->fade_from) * progress);
+    gtk_widget_queue_draw(widget);
+    return G_SOURCE_CONTINUE;
 }
 
 
-static gboolean
-gtk_scrollbox_fade_out(gpointer user_data)
+static void
+gtk_scrollbox_start_fade(GtkScrollbox *self,
+                         const gint from,
+                         const gint to)
 {
-    GtkScrollbox *self = GTK_SCROLLBOX(user_data);
-    GtkAllocation allocation;
-
-    /* increase counter */
-    if (self->orientation == GTK_ORIENTATION_HORIZONTAL)
-        self->offset++;
-    else
-        self->offset--;
-
-    gtk_widget_queue_draw(GTK_WIDGET(self));
-    gtk_widget_get_allocation (GTK_WIDGET (self), &allocation);
-
-    if ((self->orientation == GTK_ORIENTATION_HORIZONTAL &&
-         self->offset < allocation.height) ||
-        (self->orientation == GTK_ORIENTATION_VERTICAL &&
-         self->offset > 0 - allocation.width))
-        return TRUE;
-
-    (void) gtk_scrollbox_control_loop(self);
-    return FALSE;
+    self->offset = from;
+    self->fade_from = from;
+    self->fade_to = to;
+    self->fade_start = 0;
+    self->last_frame = 0;
+    if (self->tick_id == 0)
+        self->tick_id = gtk_widget_add_tick_callback(GTK_WIDGET(self),
+                                                     gtk_scrollbox_tick,
+                                                     NULL, NULL);
 }
 
 
@@ -371,10 +578,7 @@ gtk_scrollbox_control_loop(gpointer user_data)
     GtkScrollbox *self = GTK_SCROLLBOX(user_data);
     GtkAllocation allocation;
 
-    if (self->timeout_id != 0) {
-        g_source_remove(self->timeout_id);
-        self->timeout_id = 0;
-    }
+    gtk_scrollbox_stop(self);
 
     /* determine what to do next */
     switch(self->fade) {
@@ -404,27 +608,32 @@ gtk_scrollbox_control_loop(gpointer user_data)
         break;
     }
 
+    /* wait for gtk_scrollbox_resume when nobody can see the labels */
+    if (!gtk_widget_get_mapped(GTK_WIDGET(self)) || self->suspended) {
+        if (!self->paused) {
+            self->paused = TRUE;
+            self->paused_since = g_get_monotonic_time();
+        }
+        return FALSE;
+    }
+
     gtk_widget_get_allocation (GTK_WIDGET (self), &allocation);
 
     /* now perform the next action */
     switch(self->fade) {
     case FADE_IN:
-        if (self->labels_len > 1) {
-            if (self->orientation == GTK_ORIENTATION_HORIZONTAL)
-                self->offset = allocation.height;
-            else
-                self->offset = 0 - allocation.width;
-        } else
-            self->offset = 0;
-        self->timeout_id = g_timeout_add(LABEL_SPEED,
-                                         gtk_scrollbox_fade_in,
-                                         self);
+        if (self->labels_len <= 1)
+            gtk_scrollbox_start_fade(self, 0, 0);
+        else if (self->orientation == GTK_ORIENTATION_HORIZONTAL)
+            gtk_scrollbox_start_fade(self, allocation.height, 0);
+        else
+            gtk_scrollbox_start_fade(self, 0 - allocation.width, 0);
         break;
     case FADE_OUT:
-        self->offset = 0;
-        self->timeout_id = g_timeout_add(LABEL_SPEED,
-                                         gtk_scrollbox_fade_out,
-                                         self);
+        if (self->orientation == GTK_ORIENTATION_HORIZONTAL)
+            gtk_scrollbox_start_fade(self, 0, allocation.height);
+        else
+            gtk_scrollbox_start_fade(self, 0, 0 - allocation.width);
         break;
     case FADE_SLEEP:
         self->timeout_id = g_timeout_add_seconds(LABEL_SLEEP,
@@ -442,11 +651,102 @@ gtk_scrollbox_control_loop(gpointer user_data)
         break;
     }
 
-    gtk_widget_queue_resize(GTK_WIDGET(self));
     return FALSE;
 }
 
 
+/*
+ * Estimate the frames that would have been drawn while paused, from
+ * the share of time spent animating and the display refresh rate.
+ * These frames never happen, so they can only be estimated and are
+ * kept apart from the frames actually skipped for max_fps.
+ */
+static void
+gtk_scrollbox_estimate_paused_frames(GtkScrollbox *self)
+{
+    GdkFrameClock *frame_clock;
+    gint64 elapsed, cycle, fading, refresh = 0;
+
+    if (!self->animate || self->labels_len <= 1 || self->duration == 0)
+        return;
+
+    frame_clock = gtk_widget_get_frame_clock(GTK_WIDGET(self));
+    if (frame_clock)
+        gdk_frame_clock_get_refresh_info(frame_clock, 0, &refresh, NULL);
+    if (refresh <= 0)
+        refresh = G_USEC_PER_SEC / 60;
+    if (self->max_fps > 0)
+        refresh = MAX(refresh, G_USEC_PER_SEC / self->max_fps);
+
+    elapsed = g_get_monotonic_time() - self->paused_since;
+    fading = 2 * self->duration * G_GINT64_CONSTANT(1000);
+    cycle = fading + LABEL_SLEEP * G_USEC_PER_SEC;
+    self->paused_frames += (elapsed / cycle) * (fading / refresh);
+}
+
+
+/*
+ * Stop the control loop while the labels cannot be seen.
+ */
+static void
+gtk_scrollbox_pause(GtkScrollbox *self)
+{
+    if (self->paused || (self->timeout_id == 0 && self->tick_id == 0))
+        return;
+
+    gtk_scrollbox_stop(self);
+    self->paused = TRUE;
+    self->paused_since = g_get_monotonic_time();
+}
+
+
+/*
+ * Continue the control loop with the current label, skipping the
+ * animations that have been missed, so there is only a single redraw.
+ */
+static void
+gtk_scrollbox_resume(GtkScrollbox *self)
+{
+    if (!self->paused || self->suspended ||
+        !gtk_widget_get_mapped(GTK_WIDGET(self)))
+        return;
+
+    gtk_scrollbox_estimate_paused_frames(self);
+    self->paused = FALSE;
+
+    /* show labels that have been updated meanwhile right away */
+    if (self->labels_new)
+        gtk_scrollbox_swap_labels(self);
+
+    if (self->fade == FADE_IN || self->fade == FADE_OUT) {
+        self->fade = FADE_SLEEP;
+        self->offset = 0;
+    }
+    self->timeout_id =
+        g_timeout_add_seconds((self->fade == FADE_NONE)
+                              ? LABEL_SLEEP_LONG : LABEL_SLEEP,
+                              gtk_scrollbox_control_loop,
+                              self);
+    gtk_widget_queue_draw(GTK_WIDGET(self));
+}
+
+
+static void
+gtk_scrollbox_map(GtkWidget *widget)
+{
+    GTK_WIDGET_CLASS(gtk_scrollbox_parent_class)->map(widget);
+    gtk_scrollbox_resume(GTK_SCROLLBOX(widget));
+}
+
+
+static void
+gtk_scrollbox_unmap(GtkWidget *widget)
+{
+    gtk_scrollbox_pause(GTK_SCROLLBOX(widget));
+    GTK_WIDGET_CLASS(gtk_scrollbox_parent_class)->unmap(widget);
+}
+
+
 void
 gtk_scrollbox_set_orientation(GtkScrollbox *self,
                               const GtkOrientation orientation)
@@ -454,6 +754,8 @@ gtk_scrollbox_set_orientation(GtkScrollbox *self,
     g_return_if_fail(GTK_IS_SCROLLBOX(self));
 
     self->orientation = orientation;
+    gtk_scrollbox_clear_surfaces(self);
+    gtk_scrollbox_size_request(GTK_WIDGET(self), &self->requisition);
     gtk_widget_queue_resize(GTK_WIDGET(self));
 }
 
@@ -481,10 +783,7 @@ gtk_scrollbox_reset(GtkScrollbox *self)
 {
     g_return_if_fail(GTK_IS_SCROLLBOX(self));
 
-    if (self->timeout_id != 0) {
-        g_source_remove(self->timeout_id);
-        self->timeout_id = 0;
-    }
+    gtk_scrollbox_stop(self);
     self->fade = FADE_OUT;
     gtk_scrollbox_prev_label(self);
     (void) gtk_scrollbox_control_loop(self);
@@ -501,6 +800,68 @@ gtk_scrollbox_set_animate(GtkScrollbox *self,
 }
 
 
+/*
+ * Set the duration of a fade in or out in milliseconds.
+ */
+void
+gtk_scrollbox_set_animation_duration(GtkScrollbox *self,
+                                     const guint duration)
+{
+    g_return_if_fail(GTK_IS_SCROLLBOX(self));
+
+    self->duration = duration;
+}
+
+
+/*
+ * Limit the frame rate of animations, 0 means no limit other than
+ * that of the frame clock.
+ */
+void
+gtk_scrollbox_set_max_fps(GtkScrollbox *self,
+                          const guint max_fps)
+{
+    g_return_if_fail(GTK_IS_SCROLLBOX(self));
+
+    self->max_fps = max_fps;
+}
+
+
+/*
+ * Suspend the animation, e.g. while the screensaver is active.
+ */
+void
+gtk_scrollbox_set_suspended(GtkScrollbox *self,
+                            const gboolean suspended)
+{
+    g_return_if_fail(GTK_IS_SCROLLBOX(self));
+
+    self->suspended = suspended;
+    if (suspended)
+        gtk_scrollbox_pause(self);
+    else
+        gtk_scrollbox_resume(self);
+}
+
+
+guint
+gtk_scrollbox_get_skipped_frames(GtkScrollbox *self)
+{
+    g_return_val_if_fail(GTK_IS_SCROLLBOX(self), 0);
+
+    return self->skipped_frames;
+}
+
+
+guint
+gtk_scrollbox_get_paused_frames(GtkScrollbox *self)
+{
+    g_return_val_if_fail(GTK_IS_SCROLLBOX(self), 0);
+
+    return self->paused_frames;
+}
+
+
 void
 gtk_scrollbox_set_visible(GtkScrollbox *self,
                           const gboolean visible)
@@ -510,7 +871,7 @@ gtk_scrollbox_set_visible(GtkScrollbox *self,
     gtk_widget_set_visible(GTK_WIDGET(self), visible);
     self->visible = visible;
     if (visible) {
-        if (self->timeout_id == 0) {
+        if (self->timeout_id == 0 && self->tick_id == 0 && !self->paused) {
             self->fade = FADE_NONE;
             (void) gtk_scrollbox_control_loop(self);
         } else {
@@ -519,11 +880,10 @@ gtk_scrollbox_set_visible(GtkScrollbox *self,
             if (self->active == NULL || self->labels_len <= 1)
                 (void) gtk_scrollbox_control_loop(self);
         }
-    } else
-        if (self->timeout_id != 0) {
-            g_source_remove(self->timeout_id);
-            self->timeout_id = 0;
-        }
+    } else {
+        gtk_scrollbox_stop(self);
+        self->paused = FALSE;
+    }
 }
 
 
@@ -568,7 +928,8 @@ gtk_scrollbox_set_fontname(GtkScrollbox *self,
 
     /* update all labels */
     gtk_scrollbox_set_font(self, NULL);
-    gtk_widget_queue_resize(GTK_WIDGET(self));
+    gtk_scrollbox_queue_resize(self);
+    gtk_widget_queue_draw(GTK_WIDGET(self));
 }
 
 
@@ -592,7 +953,8 @@ gtk_scrollbox_set_color(GtkScrollbox *self,
 
     /* update all labels */
     gtk_scrollbox_set_font(self, NULL);
-    gtk_widget_queue_resize(GTK_WIDGET(self));
+    gtk_scrollbox_queue_resize(self);
+    gtk_widget_queue_draw(GTK_WIDGET(self));
 }
 
 
@@ -606,5 +968,6 @@ gtk_scrollbox_clear_color(GtkScrollbox *self)
 
     /* update all labels */
     gtk_scrollbox_set_font(self, NULL);
-    gtk_widget_queue_resize(GTK_WIDGET(self));
+    gtk_scrollbox_queue_resize(self);
+    gtk_widget_queue_draw(GTK_WIDGET(self));
 }
@@ -55,7 +55,20 @@ struct _GtkScrollbox {
     GList *active;
     guint labels_len;
     guint timeout_id;
+    guint tick_id;
     gint offset;
+    gint fade_from;
+    gint fade_to;
+    gint64 fade_start;          /* frame time, 0 before the first frame */
+    gint64 last_frame;
+    guint duration;             /* of a fade in or out, in ms */
+    guint max_fps;              /* 0 for no limit */
+    gboolean suspended;         /* by the user of the widget */
+    gboolean paused;            /* suspended or unmapped while running */
+    gint64 paused_since;
+    guint skipped_frames;       /* ticks skipped for max_fps */
+    guint paused_frames;        /* estimated frames saved while paused */
+    GtkRequisition requisition; /* of the labels when last resized */
     gboolean animate;
     gboolean visible;
     fade_states fade;
@@ -87,6 +100,19 @@ void gtk_scrollbox_reset(GtkScrollbox *self);
 void gtk_scrollbox_set_animate(GtkScrollbox *self,
                                gboolean animate);
 
+void gtk_scrollbox_set_animation_duration(GtkScrollbox *self,
+                                          guint duration);
+
+void gtk_scrollbox_set_max_fps(GtkScrollbox *self,
+                               guint max_fps);
+
+void gtk_scrollbox_set_suspended(GtkScrollbox *self,
+                                 gboolean suspended);
+
+guint gtk_scrollbox_get_skipped_frames(GtkScrollbox *self);
+
+guint gtk_scrollbox_get_paused_frames(GtkScrollbox *self);
+
 void gtk_scrollbox_set_visible(GtkScrollbox *self,
                                gboolean visible);
 
@@ -641,7 +641,7 @@ get_dayname(gint day)
 
 static gchar *
 forecast_cell_get_tooltip_text(plugin_data *data,
-                               xml_time *fcdata)
+                               const xml_time *fcdata)
 {
     GString *text;
     gchar *result, *value;
@@ -856,35 +856,25 @@ add_forecast_header(const gchar *text,
 
 static GtkWidget *
 add_forecast_cell(plugin_data *data,
-                  GArray *daydata,
-                  gint day,
+                  const xml_time *fcdata,
                   gint time_of_day)
 {
     GtkWidget *box, *label, *image;
-    GdkPixbuf *icon;
     gchar *wind_speed, *wind_direction, *value, *rawvalue;
-    xml_time *fcdata;
 
     box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
 
-    fcdata = make_forecast_data(data->weatherdata, daydata, day, time_of_day);
-    if (fcdata == NULL)
+    if (fcdata == NULL || fcdata->location == NULL)
         return box;
 
-    if (fcdata->location == NULL) {
-        xml_time_free(fcdata);
-        return box;
-    }
-
-    /* symbol */
+    /* symbol, loaded in the background if necessary */
     rawvalue = get_data(fcdata, data->units, SYMBOL,
                         FALSE, data->night_time);
-    icon = get_icon(data->icon_theme, rawvalue, 48, (time_of_day == NIGHT));
+    image = gtk_image_new();
+    icon_image_set_async(GTK_IMAGE(image), data->icon_theme, rawvalue, 48,
+                         (time_of_day == NIGHT), data->summary_cancellable);
     g_free(rawvalue);
-    image = gtk_image_new_from_pixbuf(icon);
     gtk_box_pack_start(GTK_BOX(box), GTK_WIDGET(image), TRUE, TRUE, 0);
-    if (G_LIKELY(icon))
-        g_object_unref(G_OBJECT(icon));
 
     /* symbol description */
     rawvalue = get_data(fcdata, data->units, SYMBOL,
@@ -926,7 +916,6 @@ add_forecast_cell(plugin_data *data,
     gtk_widget_set_tooltip_markup(GTK_WIDGET(box), value);
     g_free(value);
 
-    xml_time_free(fcdata);
     return box;
 }
 
@@ -937,7 +926,7 @@ make_forecast(plugin_data *data)
     GtkWidget *grid, *ebox, *box;
     GtkWidget *forecast_box;
 
-    GArray *daydata;
+    forecast_grid *fcgrid;
     xml_astro *astro;
     gchar *dayname, *text;
     guint i;
@@ -974,6 +963,9 @@ make_forecast(plugin_data *data)
     ATTACH_DAYTIME_HEADER(_("Evening"), 3);
     ATTACH_DAYTIME_HEADER(_("Night"), 4);
 
+    /* to speed up things, first get forecast data for all days */
+    fcgrid = make_forecast_grid(data->weatherdata, data->forecast_days);
+
     for (i = 0; i < data->forecast_days; i++) {
         /* forecast day headers */
         dayname = get_dayname(i);
@@ -995,12 +987,12 @@ make_forecast(plugin_data *data)
             gtk_grid_attach (GTK_GRID (grid), GTK_WIDGET(ebox),
                              0, i+1, 1, 1);
 
-        /* to speed up things, first get forecast data for all daytimes */
-        daydata = get_point_data_for_day(data->weatherdata, i);
-
         /* get forecast data for each daytime */
         for (time_of_day = MORNING; time_of_day <= NIGHT; time_of_day++) {
-            forecast_box = add_forecast_cell(data, daydata, i, time_of_day);
+            forecast_box =
+                add_forecast_cell(data,
+                                  forecast_grid_get(fcgrid, i, time_of_day),
+                                  time_of_day);
             weather_widget_set_border_width (GTK_WIDGET (forecast_box), 4);
             gtk_widget_set_hexpand (GTK_WIDGET (forecast_box), TRUE);
             gtk_widget_set_vexpand (GTK_WIDGET (forecast_box), TRUE);
@@ -1019,8 +1011,8 @@ make_forecast(plugin_data *data)
                                  GTK_WIDGET(ebox),
                                  1+time_of_day, i+1, 1, 1);
         }
-        g_array_free(daydata, FALSE);
     }
+    forecast_grid_free(fcgrid);
     return grid;
 }
 
@@ -1175,7 +1167,6 @@ GtkWidget *
 create_summary_window(plugin_data *data)
 {
     GtkWidget *window, *notebook, *vbox, *hbox, *label, *image, *button, *box;
-    GdkPixbuf *icon;
     xml_time *conditions;
     gchar *title, *symbol;
 
@@ -1201,28 +1192,24 @@ create_summary_window(plugin_data *data)
     gtk_box_pack_start(GTK_BOX (hbox), image, FALSE, FALSE, 6);
     gtk_box_pack_start(GTK_BOX (hbox), data->summary_subtitle, FALSE, FALSE, 6);
 
+    /* symbol, loaded in the background if necessary */
     symbol = get_data(conditions, data->units, SYMBOL,
                       FALSE, data->night_time);
-    icon = get_icon(data->icon_theme, symbol, 48, data->night_time);
-    gtk_image_set_from_pixbuf (GTK_IMAGE (image), icon);
+    icon_image_set_async(GTK_IMAGE(image), data->icon_theme, symbol, 48,
+                         data->night_time, data->summary_cancellable);
     g_free(symbol);
 
     gtk_window_set_icon_name(GTK_WINDOW(window), "org.xfce.panel.weather");
 
-    if (G_LIKELY(icon))
-        g_object_unref(G_OBJECT(icon));
-
     if (data->location_name == NULL || data->weatherdata == NULL ||
         data->weatherdata->current_conditions == NULL) {
         box = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
         gtk_widget_set_valign (box, GTK_ALIGN_CENTER);
 
         gtk_widget_destroy (image);
-        icon = get_icon (data->icon_theme, NULL, 128, data->night_time);
         image = gtk_image_new ();
-        gtk_image_set_from_pixbuf (GTK_IMAGE (image), icon);
-        if (G_LIKELY (icon))
-            g_object_unref (G_OBJECT (icon));
+        icon_image_set_async (GTK_IMAGE (image), data->icon_theme, NULL, 128,
+                              data->night_time, data->summary_cancellable);
 
         gtk_box_pack_start (GTK_BOX (box), GTK_WIDGET (image),
                             FALSE, FALSE, 6);
@@ -39,6 +39,7 @@
 #include "weather-config.h"
 #include "weather-icon.h"
 #include "weather-scrollbox.h"
+#include "weather-locations.h"
 #include "weather-debug.h"
 
 #include "weather-config_ui.h"
@@ -51,16 +52,6 @@
 #define CONN_RETRY_INTERVAL_SMALL (10)
 #define CONN_RETRY_INTERVAL_LARGE (10 * 60)
 
-/* power saving update interval in seconds used as a precaution to
-   deal with suspend/resume events etc., when nothing needs to be
-   updated earlier: */
-#define POWERSAVE_UPDATE_INTERVAL (30)
-
-/* standard update interval in seconds used as a precaution to deal
-   with suspend/resume events etc., when nothing needs to be updated
-   earlier: */
-#define UPDATE_INTERVAL (10)
-
 #define DATA_AND_UNIT(var, item)                        \
     value = get_data(conditions, data->units, item,     \
                      data->round, data->night_time);    \
@@ -71,10 +62,6 @@
                           unit);                        \
     g_free(value);
 
-#define CACHE_APPEND(str, val)                  \
-    if (val)                                    \
-        g_string_append_printf(out, str, val);
-
 #define CACHE_FREE_VARS()                       \
     g_free(locname);                            \
     g_free(lat);                                \
@@ -86,6 +73,11 @@
 #define CACHE_READ_STRING(var, key)                         \
     var = g_key_file_get_string(keyfile, group, key, NULL); \
 
+#define CACHE_READ_INTERNED(var, key)           \
+    CACHE_READ_STRING(value, key);              \
+    var = value ? g_intern_string(value) : NULL; \
+    g_free(value);
+
 #define SCHEDULE_WAKEUP_COMPARE(var, reason)        \
     if (difftime(var, now_t) < diff) {              \
         data->next_wakeup = var;                    \
@@ -96,10 +88,57 @@
 
 gboolean debug_mode = FALSE;
 
+/* key file cache keys of the xml_location values, see location_values */
+static const gchar *cache_location_keys[LOC_VALUES_NUM] = {
+    "altitude",
+    "latitude",
+    "longitude",
+    "temperature_value",
+    "wind_dir_deg",
+    "wind_speed_mps",
+    "wind_speed_beaufort",
+    "humidity_value",
+    "pressure_value",
+    "clouds_percent_0",
+    "clouds_percent_1",
+    "clouds_percent_2",
+    "clouds_percent_3",
+    "fog_percent",
+    "precipitation_value"
+};
+
+
+static gchar *make_cache_filename(plugin_data *data);
 
 static void write_cache_file(plugin_data *data);
 
-static void schedule_next_wakeup(plugin_data *data);
+static void read_cache_file(plugin_data *data);
+
+
+
+/*
+ * Create a GET request. If last_modified is set, the server may
+ * answer with 304 Not Modified instead of sending the same data again.
+ */
+static SoupMessage *
+http_message_new(const gchar *uri,
+                 time_t last_modified)
+{
+    SoupMessage *msg;
+    SoupDate *date;
+    gchar *str;
+
+    msg = soup_message_new("GET", uri);
+    if (msg && last_modified > 0) {
+        date = soup_date_new_from_time_t(last_modified);
+        str = soup_date_to_string(date, SOUP_DATE_HTTP);
+        soup_message_headers_replace(msg->request_headers,
+                                     "If-Modified-Since", str);
+        g_free(str);
+        soup_date_free(date);
+    }
+    return msg;
+}
 
 
 void
@@ -115,11 +154,136 @@ weather_http_queue_request(SoupSession *session,
 }
 
 
+void
+weather_http_queue_conditional_request(SoupSession *session,
+                                       const gchar *uri,
+                                       time_t last_modified,
+                                       SoupSessionCallback callback_func,
+                                       gpointer user_data)
+{
+    SoupMessage *msg;
+
+    msg = http_message_new(uri, last_modified);
+    soup_session_queue_message(session, msg, callback_func, user_data);
+}
+
+
+/*
+ * Like weather_http_queue_conditional_request, but the response body
+ * is not buffered. Instead, chunk_func is called for every block of
+ * data as soon as it arrives, and callback_func once the download has
+ * ended. Returns the message, which is owned by the session.
+ */
+SoupMessage *
+weather_http_queue_request_chunked(SoupSession *session,
+                                   const gchar *uri,
+                                   time_t last_modified,
+                                   GCallback chunk_func,
+                                   SoupSessionCallback callback_func,
+                                   gpointer user_data)
+{
+    SoupMessage *msg;
+
+    msg = http_message_new(uri, last_modified);
+    soup_message_body_set_accumulate(msg->response_body, FALSE);
+    g_signal_connect(msg, "got-chunk", chunk_func, user_data);
+    soup_session_queue_message(session, msg, callback_func, user_data);
+    return msg;
+}
+
+
+/* parse a date header of the response, 0 if missing or invalid */
+static time_t
+http_header_time(SoupMessage *msg,
+                 const gchar *name)
+{
+    const gchar *value;
+    SoupDate *date;
+    time_t t;
+
+    value = soup_message_headers_get_one(msg->response_headers, name);
+    if (value == NULL)
+        return 0;
+    date = soup_date_new_from_string(value);
+    if (G_UNLIKELY(date == NULL))
+        return 0;
+    t = soup_date_to_time_t(date);
+    soup_date_free(date);
+    return t;
+}
+
+
+/*
+ * Remember when the server expects to have new data and what to send
+ * for revalidation, using the headers of a successful response.
+ */
+void
+update_http_validators(update_info *upi,
+                       SoupMessage *msg,
+                       time_t now_t)
+{
+    time_t expires_t, date_t, modified_t;
+
+    /* expiry is in server time, correct it for a local clock that is
+       off using the server's date */
+    expires_t = http_header_time(msg, "Expires");
+    date_t = http_header_time(msg, "Date");
+    if (expires_t > 0 && date_t > 0)
+        expires_t = now_t + (expires_t - date_t);
+    upi->expires = expires_t;
+
+    /* a 304 response does not need to repeat Last-Modified */
+    modified_t = http_header_time(msg, "Last-Modified");
+    if (modified_t > 0 || msg->status_code != SOUP_STATUS_NOT_MODIFIED) {
+        upi->last_modified = modified_t;
+        g_free(upi->url);
+        upi->url = soup_uri_to_string(soup_message_get_uri(msg), FALSE);
+    }
+
+    weather_debug("Data expires in %.0f seconds, last modified at %ld.",
+                  upi->expires ? difftime(upi->expires, now_t) : 0,
+                  (long) upi->last_modified);
+}
+
+
+/*
+ * Get the modification time to send for revalidation of url. Returns 0
+ * if the known modification time belongs to another resource, for
+ * example to yesterday's astronomical data.
+ */
+time_t
+get_http_validator(const update_info *upi,
+                   const gchar *url)
+{
+    SoupURI *uri;
+    gchar *str;
+    gboolean same;
+
+    if (upi->last_modified == 0 || upi->url == NULL)
+        return 0;
+
+    /* compare URLs the same way as they are stored */
+    uri = soup_uri_new(url);
+    if (G_UNLIKELY(uri == NULL))
+        return 0;
+    str = soup_uri_to_string(uri, FALSE);
+    same = !g_strcmp0(str, upi->url);
+    g_free(str);
+    soup_uri_free(uri);
+
+    if (!same) {
+        weather_debug("URL has changed, not sending If-Modified-Since.");
+        return 0;
+    }
+    return upi->last_modified;
+}
+
+
 static gchar *
 make_label(const plugin_data *data,
+           const xml_time *conditions,
            data_types type)
 {
-    xml_time *conditions;
     const gchar *lbl, *unit;
     gchar *str, *value;
 
@@ -175,8 +339,6 @@ make_label(const plugin_data *data,
         break;
     }
 
-    /* get current weather conditions */
-    conditions = get_current_conditions(data->weatherdata);
     unit = get_unit(data->units, type);
     value = get_data(conditions, data->units, type,
                      data->round, data->night_time);
@@ -194,7 +356,7 @@ make_label(const plugin_data *data,
 }
 
 
-static update_info *
+update_info *
 make_update_info(const guint check_interval)
 {
     update_info *upi;
@@ -210,15 +372,23 @@ make_update_info(const guint check_interval)
 }
 
 
+void
+update_info_free(update_info *upi)
+{
+    if (G_UNLIKELY(upi == NULL))
+        return;
+
+    g_free(upi->url);
+    g_slice_free(update_info, upi);
+}
+
+
 static void
 init_update_infos(plugin_data *data)
 {
-    if (G_LIKELY(data->astro_update))
-        g_slice_free(update_info, data->astro_update);
-    if (G_LIKELY(data->weather_update))
-        g_slice_free(update_info, data->weather_update);
-    if (G_LIKELY(data->conditions_update))
-        g_slice_free(update_info, data->conditions_update);
+    update_info_free(data->astro_update);
+    update_info_free(data->weather_update);
+    update_info_free(data->conditions_update);
 
     data->astro_update = make_update_info(24 * 3600);
     data->weather_update = make_update_info(60 * 60);
@@ -241,6 +411,23 @@ get_cache_directory(void)
 }
 
 
+/*
+ * Dump the plugin data along with the scrollbox counters, which are
+ * copied here so that the dump does not need GtkScrollbox.
+ */
+static gchar *
+dump_plugindata(plugin_data *data)
+{
+    if (data->scrollbox) {
+        data->scrollbox_skipped_frames =
+            gtk_scrollbox_get_skipped_frames(GTK_SCROLLBOX(data->scrollbox));
+        data->scrollbox_paused_frames =
+            gtk_scrollbox_get_paused_frames(GTK_SCROLLBOX(data->scrollbox));
+    }
+    return weather_dump_plugindata(data);
+}
+
+
 static gint
 get_tooltip_icon_size(plugin_data *data)
 {
@@ -282,31 +469,65 @@ update_offset(plugin_data *data)
 }
 
 
+static void
+cb_tooltip_icon_loaded(GObject *source,
+                       GAsyncResult *result,
+                       gpointer user_data)
+{
+    plugin_data *data = user_data;
+    GdkPixbuf *icon;
+
+    /* data may be gone if loading has been cancelled */
+    icon = get_icon_finish(result, NULL);
+    if (icon == NULL)
+        return;
+
+    if (G_LIKELY(data->tooltip_icon))
+        g_object_unref(G_OBJECT(data->tooltip_icon));
+    data->tooltip_icon = icon;
+
+    /* show the new icon if the tooltip is open */
+    gtk_widget_trigger_tooltip_query(data->button);
+}
+
+
+/*
+ * Mark the cached tooltip content as outdated, it will be rebuilt
+ * when the tooltip is shown the next time.
+ */
+void
+invalidate_tooltip(plugin_data *data)
+{
+    data->tooltip_generation++;
+}
+
+
 void
 update_icon(plugin_data *data)
 {
-    GdkPixbuf *icon;
     xml_time *conditions;
     gchar *str;
-    gint size;
 
-    /* set panel icon according to current weather conditions */
-    size = data->icon_size;
+    /* icons still loading for previous conditions are outdated */
+    if (data->icon_cancellable) {
+        g_cancellable_cancel(data->icon_cancellable);
+        g_object_unref(data->icon_cancellable);
+    }
+    data->icon_cancellable = g_cancellable_new();
+
+    /* set panel icon according to current weather conditions,
+       keeping the previous one until the new one is loaded */
     conditions = get_current_conditions(data->weatherdata);
     str = get_data(conditions, data->units, SYMBOL,
                    data->round, data->night_time);
-    icon = get_icon(data->icon_theme, str, size, data->night_time);
-    gtk_image_set_from_pixbuf(GTK_IMAGE(data->iconimage), icon);
-    if (G_LIKELY(icon))
-        g_object_unref(G_OBJECT(icon));
-
-    /* set tooltip icon too */
-    size = get_tooltip_icon_size(data);
-    if (G_LIKELY(data->tooltip_icon))
-        g_object_unref(G_OBJECT(data->tooltip_icon));
-    data->tooltip_icon = get_icon(data->icon_theme, str, size, data->night_time);
+    icon_image_set_async(GTK_IMAGE(data->iconimage), data->icon_theme,
+                         str, data->icon_size, data->night_time,
+                         data->icon_cancellable);
     g_free(str);
-    weather_debug("Updated panel and tooltip icons.");
+
+    /* the tooltip icon is loaded when it is needed */
+    invalidate_tooltip(data);
+    weather_debug("Updating panel icon.");
 }
 
 
@@ -322,6 +543,36 @@ scrollbox_set_visible(plugin_data *data)
 }
 
 
+/* add one label with all values for every additional location */
+static void
+add_location_labels(plugin_data *data)
+{
+    weather_location *loc;
+    GString *out;
+    gchar *label;
+    guint i, j;
+
+    for (i = 0; i < data->locations->len; i++) {
+        loc = g_ptr_array_index(data->locations, i);
+        if (loc->weatherdata->current_conditions == NULL ||
+            data->labels->len == 0)
+            continue;
+
+        out = g_string_sized_new(128);
+        g_string_append_printf(out, "%s:", loc->name);
+        for (j = 0; j < data->labels->len; j++) {
+            label = make_label(data, loc->weatherdata->current_conditions,
+                               g_array_index(data->labels, data_types, j));
+            g_string_append_printf(out, "%s %s", j ? "," : "", label);
+            g_free(label);
+        }
+        gtk_scrollbox_add_label(GTK_SCROLLBOX(data->scrollbox),
+                                -1, out->str);
+        g_string_free(out, TRUE);
+    }
+}
+
+
 void
 update_scrollbox(plugin_data *data,
                  gboolean immediately)
@@ -331,6 +582,7 @@ update_scrollbox(plugin_data *data,
     data_types type;
     guint i = 0, j = 0;
 
+    invalidate_tooltip(data);
     gtk_scrollbox_clear_new(GTK_SCROLLBOX(data->scrollbox));
     if (data->weatherdata && data->weatherdata->current_conditions) {
         while (i < data->labels->len) {
@@ -338,7 +590,9 @@ update_scrollbox(plugin_data *data,
             out = g_string_sized_new(128);
             while ((i + j) < data->labels->len && j < data->scrollbox_lines) {
                 type = g_array_index(data->labels, data_types, i + j);
-                label = make_label(data, type);
+                label = make_label(data,
+                                   data->weatherdata->current_conditions,
+                                   type);
                 g_string_append_printf(out, "%s%s", label,
                                        (j < (data->scrollbox_lines - 1) &&
                                         (i + j + 1) < data->labels->len
@@ -352,6 +606,7 @@ update_scrollbox(plugin_data *data,
             g_string_free(out, TRUE);
             i = i + j;
         }
+        add_location_labels(data);
         weather_debug("Added %u labels to scrollbox.", data->labels->len);
     } else {
         gtk_scrollbox_add_label(GTK_SCROLLBOX(data->scrollbox), -1,
@@ -430,6 +685,7 @@ update_current_conditions(plugin_data *data,
     data->weatherdata->current_conditions =
         make_current_conditions(data->weatherdata,
                                 data->conditions_update->last);
+    locations_update_conditions(data, data->conditions_update->last);
 
     /* update current astrodata */
     update_current_astrodata(data);
@@ -448,7 +704,7 @@ update_current_conditions(plugin_data *data,
 }
 
 
-static time_t
+time_t
 calc_next_download_time(const update_info *upi,
                         time_t retry_t) {
     struct tm retry_tm;
@@ -461,9 +717,13 @@ calc_next_download_time(const update_info *upi,
      * that, continue using a larger interval or the default check,
      * whatever is smaller.
      */
-    if (G_LIKELY(upi->attempt == 0))
+    if (G_LIKELY(upi->attempt == 0)) {
+        /* no need to ask before the server expects to have new data */
+        if (difftime(upi->expires, retry_t) > 0 &&
+            difftime(upi->expires, retry_t) <= DATA_EXPIRY_TIME)
+            return upi->expires;
         interval = upi->check_interval;
-    else if (upi->attempt <= CONN_MAX_ATTEMPTS)
+    } else if (upi->attempt <= CONN_MAX_ATTEMPTS)
         interval = CONN_RETRY_INTERVAL_SMALL;
     else {
         if (upi->check_interval > CONN_RETRY_INTERVAL_LARGE)
@@ -493,7 +753,13 @@ cb_astro_update(SoupSession *session,
     time(&now_t);
     data->astro_update->attempt++;
     data->astro_update->http_status_code = msg->status_code;
-    if ((msg->status_code == 200 || msg->status_code == 203)) {
+    if (msg->status_code == SOUP_STATUS_NOT_MODIFIED) {
+        /* the data we have is still current */
+        weather_debug("Astronomical data not modified.");
+        data->astro_update->attempt = 0;
+        data->astro_update->last = now_t;
+        update_http_validators(data->astro_update, msg, now_t);
+    } else if ((msg->status_code == 200 || msg->status_code == 203)) {
         doc = get_xml_document(msg);
         if (G_LIKELY(doc)) {
             root_node = xmlDocGetRootElement(doc);
@@ -505,6 +771,8 @@ cb_astro_update(SoupSession *session,
                             /* schedule next update */
                             data->astro_update->attempt = 0;
                             data->astro_update->last = now_t;
+                            update_http_validators(data->astro_update,
+                                                   msg, now_t);
                             parsing_error = FALSE;
                         }
                     }
@@ -532,6 +800,67 @@ cb_astro_update(SoupSession *session,
     update_icon(data);
 
     data->astro_update->finished = TRUE;
+    schedule_next_wakeup(data);
+}
+
+
+/*
+ * Create a parser for the weather data of a response, to be fed while
+ * it is being downloaded.
+ */
+xml_weather_parser *
+make_weather_parser(SoupMessage *msg,
+                    xml_weather *wd)
+{
+    GHashTable *params = NULL;
+    const gchar *charset = NULL, *encoding = NULL;
+
+    /* force parsing as UTF-8 unless the server says otherwise,
+       the XML encoding header may lie */
+    if (soup_message_headers_get_content_type(msg->response_headers,
+                                              &params) && params)
+        charset = g_hash_table_lookup(params, "charset");
+    if (charset == NULL || !g_ascii_strcasecmp(charset, "utf-8"))
+        encoding = "UTF-8";
+    if (params)
+        g_hash_table_destroy(params);
+
+    return xml_weather_parser_new(wd, encoding);
+}
+
+
+gchar *
+make_forecast_url(const gchar *lat,
+                  const gchar *lon,
+                  gint msl)
+{
+    return g_strdup_printf("https://api.met.no"
+                           "/weatherapi/locationforecast/%s/"
+                           "classic?lat=%s&lon=%s&altitude=%d",
+                           FORECAST_API, lat, lon, msl);
+}
+
+
+/*
+ * Feed weather data to the parser while it is being downloaded, so
+ * that the document never has to be kept in memory as a whole.
+ */
+static void
+cb_weather_chunk(SoupMessage *msg,
+                 SoupBuffer *chunk,
+                 gpointer user_data)
+{
+    plugin_data *data = user_data;
+
+    if (msg->status_code != 200 && msg->status_code != 203)
+        return;
+
+    if (data->weather_parser == NULL) {
+        data->weather_parser = make_weather_parser(msg, data->weatherdata);
+        if (G_UNLIKELY(data->weather_parser == NULL))
+            return;
+    }
+    xml_weather_parser_feed(data->weather_parser, chunk->data, chunk->length);
 }
 
 
@@ -544,8 +873,6 @@ cb_weather_update(SoupSession *session,
                   gpointer user_data)
 {
     plugin_data *data = user_data;
-    xmlDoc *doc;
-    xmlNode *root_node;
     time_t now_t;
     gboolean parsing_error = TRUE;
 
@@ -553,24 +880,37 @@ cb_weather_update(SoupSession *session,
     time(&now_t);
     data->weather_update->attempt++;
     data->weather_update->http_status_code = msg->status_code;
-    if (msg->status_code == 200 || msg->status_code == 203) {
-        doc = get_xml_document(msg);
-        if (G_LIKELY(doc)) {
-            root_node = xmlDocGetRootElement(doc);
-            if (G_LIKELY(root_node))
-                if (parse_weather(root_node, data->weatherdata)) {
-                    data->weather_update->attempt = 0;
-                    data->weather_update->last = now_t;
-                    parsing_error = FALSE;
-                }
-            xmlFreeDoc(doc);
+    if (msg->status_code == SOUP_STATUS_NOT_MODIFIED) {
+        /* the data we have is still current, nothing to parse */
+        weather_debug("Weather data not modified.");
+        data->weather_update->attempt = 0;
+        data->weather_update->last = now_t;
+        update_http_validators(data->weather_update, msg, now_t);
+        if (data->weather_parser) {
+            xml_weather_parser_free(data->weather_parser);
+            data->weather_parser = NULL;
+        }
+    } else if (msg->status_code == 200 || msg->status_code == 203) {
+        /* the data has been parsed already while it was downloaded */
+        if (G_LIKELY(data->weather_parser) &&
+            xml_weather_parser_finish(data->weather_parser)) {
+            data->weather_update->attempt = 0;
+            data->weather_update->last = now_t;
+            update_http_validators(data->weather_update, msg, now_t);
+            parsing_error = FALSE;
         }
+        data->weather_parser = NULL;
         if (parsing_error)
             g_warning(_("Error parsing weather data!"));
-    } else
+    } else {
         g_warning
             (_("Download of weather data failed with HTTP Status Code %d, "
                "Reason phrase: %s"), msg->status_code, msg->reason_phrase);
+        if (data->weather_parser) {
+            xml_weather_parser_free(data->weather_parser);
+            data->weather_parser = NULL;
+        }
+    }
     data->weather_update->next = calc_next_download_time(data->weather_update,
                                                          now_t);
 
@@ -582,17 +922,141 @@ cb_weather_update(SoupSession *session,
     gtk_scrollbox_reset(GTK_SCROLLBOX(data->scrollbox));
 
     data->weather_update->finished = TRUE;
+    schedule_next_wakeup(data);
     weather_dump(weather_dump_weatherdata, data->weatherdata);
 }
 
 
+/* check whether all started downloads are finished */
+static gboolean
+downloads_finished(const plugin_data *data)
+{
+    if (!data->astro_update->started && !data->weather_update->started)
+        return FALSE;
+    return ((!data->astro_update->started || data->astro_update->finished) &&
+            (!data->weather_update->started ||
+             data->weather_update->finished));
+}
+
+
+/*
+ * Read the data another plugin instance showing the same location has
+ * written to the cache file, if it has been downloaded more recently
+ * than our own.
+ */
+static gboolean
+read_shared_cache_file(plugin_data *data,
+                       const gchar *file)
+{
+    weather_cache_info info;
+    gdouble weather_diff, astro_diff;
+
+    memset(&info, 0, sizeof(info));
+    info.lat = data->lat;
+    info.lon = data->lon;
+    info.offset = data->offset;
+    info.msl = data->msl;
+    if (weather_cache_read(file, &info, data->cache_file_max_age,
+                           NULL, NULL) != WEATHER_CACHE_OK)
+        return FALSE;
+    g_free(info.weather_url);
+    g_free(info.astro_url);
+
+    weather_diff = difftime(info.last_weather_download,
+                            data->weather_update->last);
+    astro_diff = difftime(info.last_astro_download,
+                          data->astro_update->last);
+    if (weather_diff < 0 || astro_diff < 0 ||
+        (weather_diff == 0 && astro_diff == 0))
+        return FALSE;
+
+    weather_debug("Using data downloaded by another plugin instance.");
+    read_cache_file(data);
+    update_current_conditions(data, TRUE);
+    return TRUE;
+}
+
+
+/*
+ * Plugin instances showing the same location share the cache file, so
+ * only one of them needs to download the data. The others wait for it
+ * and then read the results from the cache file.
+ */
+static void
+share_downloads(plugin_data *data,
+                time_t now_t)
+{
+    gchar *file;
+
+    if (data->download_lock >= 0 ||
+        (difftime(data->astro_update->next, now_t) > 0 &&
+         difftime(data->weather_update->next, now_t) > 0))
+        return;
+
+    file = make_cache_filename(data);
+    if (G_UNLIKELY(file == NULL))
+        return;
+
+    if (read_shared_cache_file(data, file) &&
+        difftime(data->astro_update->next, now_t) > 0 &&
+        difftime(data->weather_update->next, now_t) > 0) {
+        g_free(file);
+        return;
+    }
+
+    if (!weather_cache_lock(file, &data->download_lock)) {
+        weather_debug("Another plugin instance is downloading data "
+                      "for this location, waiting for it.");
+        if (difftime(data->astro_update->next, now_t) <= 0)
+            data->astro_update->next = now_t + SHARED_DOWNLOAD_WAIT;
+        if (difftime(data->weather_update->next, now_t) <= 0)
+            data->weather_update->next = now_t + SHARED_DOWNLOAD_WAIT;
+    }
+    g_free(file);
+}
+
+
+static void
+release_download_lock(plugin_data *data)
+{
+    weather_cache_unlock(data->download_lock);
+    data->download_lock = -1;
+}
+
+
+/* check whether the main location has been configured */
+static gboolean
+main_location_configured(const plugin_data *data)
+{
+    return data->lat != NULL && data->lon != NULL;
+}
+
+
+/*
+ * Start the downloads of the main location along with those of the
+ * additional locations if they are due soon, as it is done the other
+ * way round in locations_download.
+ */
+static void
+batch_main_downloads(plugin_data *data,
+                     time_t now_t)
+{
+    if (!(data->astro_update->started && !data->astro_update->finished) &&
+        difftime(data->astro_update->next, now_t) <= LOCATION_BATCH_WINDOW)
+        data->astro_update->next = now_t;
+    if (!(data->weather_update->started &&
+          !data->weather_update->finished) &&
+        difftime(data->weather_update->next, now_t) <= LOCATION_BATCH_WINDOW)
+        data->weather_update->next = now_t;
+}
+
+
 static gboolean
 update_handler(gpointer user_data)
 {
     plugin_data *data = user_data;
-    gchar *api_version = FORECAST_API;
     gchar *url;
-    gboolean night_time;
+    gboolean night_time, configured, main_due = FALSE;
     time_t now_t;
     struct tm now_tm;
 
@@ -600,9 +1064,15 @@ update_handler(gpointer user_data)
     if (G_UNLIKELY(data == NULL))
         return FALSE;
 
+    data->wakeups++;
+    weather_debug("Wakeup number %u.", data->wakeups);
+
     /* plugin has not been configured yet, so simply update icon and
-       scrollbox and return */
-    if (G_UNLIKELY(data->lat == NULL || data->lon == NULL)) {
+       scrollbox and return; additional locations are handled even
+       without the main one */
+    configured = main_location_configured(data);
+    if (G_UNLIKELY(!configured &&
+                   (data->locations == NULL || data->locations->len == 0))) {
         update_icon(data);
         update_scrollbox(data, TRUE);
         return FALSE;
@@ -611,19 +1081,31 @@ update_handler(gpointer user_data)
     now_t = time(NULL);
     now_tm = *localtime(&now_t);
 
-    /* check if all started downloads are finished and the cache file
-       can be written */
-    if (data->astro_update->started && data->astro_update->finished &&
-        data->weather_update->started && data->weather_update->finished) {
-        data->astro_update->started = FALSE;
-        data->astro_update->finished = FALSE;
-        data->weather_update->started = FALSE;
-        data->weather_update->finished = FALSE;
-        write_cache_file(data);
+    if (configured) {
+        /* check if all started downloads are finished and the cache
+           file can be written */
+        if (downloads_finished(data)) {
+            data->astro_update->started = FALSE;
+            data->astro_update->finished = FALSE;
+            data->weather_update->started = FALSE;
+            data->weather_update->finished = FALSE;
+            write_cache_file(data);
+        }
+
+        if (locations_due(data, now_t))
+            batch_main_downloads(data, now_t);
+
+        share_downloads(data, now_t);
+
+        main_due = (difftime(data->astro_update->next, now_t) <= 0 ||
+                    difftime(data->weather_update->next, now_t) <= 0);
     }
 
+    /* download the additional locations along with the main one */
+    locations_download(data, now_t, main_due);
+
     /* fetch astronomical data */
-    if (difftime(data->astro_update->next, now_t) <= 0) {
+    if (configured && difftime(data->astro_update->next, now_t) <= 0) {
         /* real next update time will be calculated when update is finished,
            this is to prevent spawning multiple updates in a row */
         data->astro_update->next = time_calc_hour(now_tm, 1);
@@ -643,29 +1125,30 @@ update_handler(gpointer user_data)
 
         /* start receive thread */
         g_message(_("getting %s"), url);
-        weather_http_queue_request(data->session, url,
-                                   cb_astro_update, data);
+        weather_http_queue_conditional_request(data->session, url,
+                                               get_http_validator(data->astro_update,
+                                                                  url),
+                                               cb_astro_update, data);
         g_free(url);
     }
 
     /* fetch weather data */
-    if (difftime(data->weather_update->next, now_t) <= 0) {
+    if (configured && difftime(data->weather_update->next, now_t) <= 0) {
         /* real next update time will be calculated when update is finished,
            this is to prevent spawning multiple updates in a row */
         data->weather_update->next = time_calc_hour(now_tm, 1);
         data->weather_update->started = TRUE;
 
         /* build url */
-        url = g_strdup_printf("https://api.met.no"
-                              "/weatherapi/locationforecast/%s/"
-                              "classic?lat=%s&lon=%s&altitude=%d",
-                              api_version,
-                              data->lat, data->lon, data->msl);
+        url = make_forecast_url(data->lat, data->lon, data->msl);
 
         /* start receive thread */
         g_message(_("getting %s"), url);
-        weather_http_queue_request(data->session, url,
-                                   cb_weather_update, data);
+        weather_http_queue_request_chunked(data->session, url,
+                                           get_http_validator(data->weather_update,
+                                                              url),
+                                           G_CALLBACK(cb_weather_chunk),
+                                           cb_weather_update, data);
         g_free(url);
 
         /* cb_weather_update will deal with everything that follows this
@@ -699,10 +1182,10 @@ update_handler(gpointer user_data)
 }
 
 
-static void
+void
 schedule_next_wakeup(plugin_data *data)
 {
-    time_t now_t = time(NULL), next_day_t;
+    time_t now_t = time(NULL), next_day_t, next_location_t;
     gdouble diff;
     gchar *date;
     GSource *source;
@@ -718,12 +1201,17 @@ schedule_next_wakeup(plugin_data *data)
     next_day_t = day_at_midnight(now_t, 1);
     diff = difftime(next_day_t, now_t);
     data->next_wakeup_reason = "current astro data update";
-    SCHEDULE_WAKEUP_COMPARE(data->astro_update->next,
-                            "astro data download");
-    SCHEDULE_WAKEUP_COMPARE(data->weather_update->next,
-                            "weather data download");
+    if (main_location_configured(data)) {
+        SCHEDULE_WAKEUP_COMPARE(data->astro_update->next,
+                                "astro data download");
+        SCHEDULE_WAKEUP_COMPARE(data->weather_update->next,
+                                "weather data download");
+    }
     SCHEDULE_WAKEUP_COMPARE(data->conditions_update->next,
                             "current conditions update");
+    if (locations_next_download(data, &next_location_t))
+        SCHEDULE_WAKEUP_COMPARE(next_location_t,
+                                "additional locations download");
 
     /* If astronomical data is unavailable, current conditions update
        will usually handle night/day. */
@@ -738,21 +1226,11 @@ schedule_next_wakeup(plugin_data *data)
                                     "sunset icon change");
     }
 
-#ifdef HAVE_UPOWER_GLIB
-    if (data->upower_on_battery && diff > POWERSAVE_UPDATE_INTERVAL) {
-        /* next wakeup time is greater than the power saving check
-           interval, so call the update handler earlier to deal with
-           cases like system resume events etc. */
-        diff = POWERSAVE_UPDATE_INTERVAL;
-        data->next_wakeup_reason = "regular check (power saving)";
-    } else
-#endif
-    if (diff > UPDATE_INTERVAL) {
-        /* next wakeup time is greater than the standard check
-           interval, so call the update handler earlier to deal with
-           cases like system resume events etc. */
-        diff = UPDATE_INTERVAL;
-        data->next_wakeup_reason = "regular check";
+    /* All downloads are finished, so wake up right away to write the
+       cache file. */
+    if (downloads_finished(data)) {
+        diff = 0;
+        data->next_wakeup_reason = "cache file update";
     } else if (diff < 0) {
         /* last wakeup time expired, force update immediately */
         diff = 0;
@@ -762,14 +1240,9 @@ schedule_next_wakeup(plugin_data *data)
     date = format_date(now_t, "%Y-%m-%d %H:%M:%S", TRUE);
     data->update_timer =
         g_timeout_add_seconds((guint) diff, update_handler, data);
-    if (!strcmp(data->next_wakeup_reason, "regular check"))
-        weather_debug("[%s]: Running regular check for updates, "
-                      "interval %d secs.", date, UPDATE_INTERVAL);
-    else {
-        weather_dump(weather_dump_plugindata, data);
-        weather_debug("[%s]: Next wakeup in %.0f seconds, reason: %s",
-                      date, diff, data->next_wakeup_reason);
-    }
+    weather_dump(dump_plugindata, data);
+    weather_debug("[%s]: Next wakeup in %.0f seconds, reason: %s",
+                  date, diff, data->next_wakeup_reason);
     g_free(date);
 }
 
@@ -882,14 +1355,28 @@ xfceweather_xfconf_get_string (plugin_data *data, gchar* setting)
 }
 
 
+static gchar *
+xfceweather_xfconf_get_location_string (plugin_data *data, const gchar *location, const gchar *key)
+{
+    gchar          *setting, *value;
+
+    setting = g_strconcat (location, key, NULL);
+    value = xfceweather_xfconf_get_string (data, setting);
+    g_free (setting);
+
+    return value;
+}
+
+
 static void
 xfceweather_read_config (XfcePanelPlugin *plugin,
                          plugin_data *data)
 {
     const gchar *value;
-    gchar *property;
-    gchar label[10];
+    gchar *property, *msl_property, *name, *lat, *lon;
+    gchar label[10], location[20];
     gint label_count = 0, val;
+    guint i;
 
     g_return_if_fail (XFCONF_IS_CHANNEL (data->channel));
 
@@ -954,6 +1441,14 @@ xfceweather_read_config (XfcePanelPlugin *plugin,
     data->scrollbox_animate = xfceweather_xfconf_get_bool (data, SETTING_SB_ANIMATE, TRUE);
     gtk_scrollbox_set_animate (GTK_SCROLLBOX(data->scrollbox),
                                data->scrollbox_animate);
+    data->scrollbox_duration = xfceweather_xfconf_get_int (data, SETTING_SB_DURATION, DEFAULT_SCROLLBOX_DURATION);
+    constrain_to_ulimits(&data->scrollbox_duration, 0, MAX_SCROLLBOX_DURATION);
+    gtk_scrollbox_set_animation_duration (GTK_SCROLLBOX(data->scrollbox),
+                                          data->scrollbox_duration);
+    data->scrollbox_max_fps = xfceweather_xfconf_get_int (data, SETTING_SB_MAX_FPS, 0);
+    constrain_to_ulimits(&data->scrollbox_max_fps, 0, MAX_SCROLLBOX_FPS);
+    gtk_scrollbox_set_max_fps (GTK_SCROLLBOX(data->scrollbox),
+                               data->scrollbox_max_fps);
 
     data->labels = labels_clear(data->labels);
     val = 0;
@@ -968,6 +1463,32 @@ xfceweather_read_config (XfcePanelPlugin *plugin,
         g_free (property);
     }
 
+    /* Additional locations */
+    g_ptr_array_set_size (data->locations, 0);
+    for (i = 0; ; i++) {
+        g_snprintf(location, 20, "/location%u", i);
+        property = g_strconcat (SETTING_LOCATIONS, location, NULL);
+        lat = xfceweather_xfconf_get_location_string (data, property, "/latitude");
+        lon = xfceweather_xfconf_get_location_string (data, property, "/longitude");
+        if (lat == NULL || lon == NULL) {
+            g_free (lat);
+            g_free (lon);
+            g_free (property);
+            break;
+        }
+        name = xfceweather_xfconf_get_location_string (data, property, "/name");
+        msl_property = g_strconcat (property, "/msl", NULL);
+        val = xfceweather_xfconf_get_int (data, msl_property, 0);
+        constrain_to_limits(&val, -420, 10000);
+        g_ptr_array_add (data->locations,
+                         weather_location_new (data, name, lat, lon, val));
+        g_free (msl_property);
+        g_free (name);
+        g_free (lat);
+        g_free (lon);
+        g_free (property);
+    }
+
     weather_debug("Config file read.");
 }
 
@@ -975,9 +1496,10 @@ static void
 xfceweather_write_config (XfcePanelPlugin *plugin,
                           plugin_data *data)
 {
-    gchar           label[10];
+    gchar           label[10], location[20];
     guint           i;
     gchar          *property;
+    weather_location *loc;
 
     g_return_if_fail (XFCONF_IS_CHANNEL (data->channel));
 
@@ -1029,6 +1551,8 @@ xfceweather_write_config (XfcePanelPlugin *plugin,
     /* Scrollbox */
     xfceweather_xfconf_set_intbool (data, SETTING_SB_SHOW, data->show_scrollbox, TRUE);
     xfceweather_xfconf_set_intbool (data, SETTING_SB_ANIMATE, data->scrollbox_animate, TRUE);
+    xfceweather_xfconf_set_intbool (data, SETTING_SB_DURATION, data->scrollbox_duration, FALSE);
+    xfceweather_xfconf_set_intbool (data, SETTING_SB_MAX_FPS, data->scrollbox_max_fps, FALSE);
     xfceweather_xfconf_set_intbool (data, SETTING_SB_LINES, data->scrollbox_lines, FALSE);
     if (data->scrollbox_font)
     {
@@ -1051,6 +1575,28 @@ xfceweather_write_config (XfcePanelPlugin *plugin,
         g_free (property);
     }
 
+    /* Additional locations */
+    property = g_strconcat (data->property_base, SETTING_LOCATIONS, NULL);
+    xfconf_channel_reset_property (data->channel, property, TRUE);
+    g_free (property);
+
+    for (i = 0; i < data->locations->len; i++) {
+        loc = g_ptr_array_index (data->locations, i);
+        g_snprintf(location, 20, "/location%u", i);
+        property = g_strconcat (SETTING_LOCATIONS, location, "/name", NULL);
+        xfceweather_xfconf_set_string (data, property, loc->name);
+        g_free (property);
+        property = g_strconcat (SETTING_LOCATIONS, location, "/latitude", NULL);
+        xfceweather_xfconf_set_string (data, property, loc->lat);
+        g_free (property);
+        property = g_strconcat (SETTING_LOCATIONS, location, "/longitude", NULL);
+        xfceweather_xfconf_set_string (data, property, loc->lon);
+        g_free (property);
+        property = g_strconcat (SETTING_LOCATIONS, location, "/msl", NULL);
+        xfceweather_xfconf_set_intbool (data, property, loc->msl, FALSE);
+        g_free (property);
+    }
+
     weather_debug("Config written.");
 }
 
@@ -1075,137 +1621,66 @@ make_cache_filename(plugin_data *data)
 }
 
 
+/*
+ * Write the cache file in the background. The download lock is handed
+ * over to the writer, which releases it once the file has been
+ * written.
+ */
 static void
 write_cache_file(plugin_data *data)
 {
-    GString *out;
-    xml_weather *wd = data->weatherdata;
-    xml_time *timeslice;
-    xml_location *loc;
-    xml_astro *astro;
-    gchar *file, *start, *end, *point, *now, *value;
-    gchar *date_format = "%Y-%m-%dT%H:%M:%SZ";
-    time_t now_t = time(NULL);
-    guint i, j;
+    weather_cache_info info;
+    GBytes *contents;
+    gchar *file;
 
     file = make_cache_filename(data);
-    if (G_UNLIKELY(file == NULL))
+    if (G_UNLIKELY(file == NULL)) {
+        release_download_lock(data);
         return;
+    }
 
-    out = g_string_sized_new(20480);
-    g_string_assign(out, "# xfce4-weather-plugin cache file\n\n[info]\n");
-    CACHE_APPEND("location_name=%s\n", data->location_name);
-    CACHE_APPEND("lat=%s\n", data->lat);
-    CACHE_APPEND("lon=%s\n", data->lon);
-    CACHE_APPEND("offset=%s\n", data->offset);
-    g_string_append_printf(out, "msl=%d\n", data->msl);
-    g_string_append_printf(out, "timeslices=%d\n", wd->timeslices->len);
+    memset(&info, 0, sizeof(info));
+    info.location_name = data->location_name;
+    info.lat = data->lat;
+    info.lon = data->lon;
+    info.offset = data->offset;
+    info.msl = data->msl;
+    info.cache_date = time(NULL);
     if (G_LIKELY(data->weather_update)) {
-        value = format_date(data->weather_update->last, date_format, FALSE);
-        CACHE_APPEND("last_weather_download=%s\n", value);
-        g_free(value);
+        info.last_weather_download = data->weather_update->last;
+        info.weather_expires = data->weather_update->expires;
+        info.weather_last_modified = data->weather_update->last_modified;
+        info.weather_url = data->weather_update->url;
     }
     if (G_LIKELY(data->astro_update)) {
-        value = format_date(data->astro_update->last, date_format, FALSE);
-        CACHE_APPEND("last_astro_download=%s\n", value);
-        g_free(value);
+        info.last_astro_download = data->astro_update->last;
+        info.astro_expires = data->astro_update->expires;
+        info.astro_last_modified = data->astro_update->last_modified;
+        info.astro_url = data->astro_update->url;
     }
-    now = format_date(now_t, date_format, FALSE);
-    CACHE_APPEND("cache_date=%s\n\n", now);
-    g_free(now);
 
-    if (data->astrodata) {
-        for (i = 0; i < data->astrodata->len; i++) {
-            astro = g_array_index(data->astrodata, xml_astro *, i);
-            if (G_UNLIKELY(astro == NULL))
-                continue;
-            value = format_date(astro->day, "%Y-%m-%d", TRUE);
-            start = format_date(astro->sunrise, date_format, TRUE);
-            end = format_date(astro->sunset, date_format, TRUE);
-            g_string_append_printf(out, "[astrodata%d]\n", i);
-            CACHE_APPEND("day=%s\n", value);
-            CACHE_APPEND("sunrise=%s\n", start);
-            CACHE_APPEND("sunset=%s\n", end);
-            CACHE_APPEND("sun_never_rises=%s\n",
-                         astro->sun_never_rises ? "true" : "false");
-            CACHE_APPEND("sun_never_sets=%s\n",
-                         astro->sun_never_sets ? "true" : "false");
-            CACHE_APPEND("solarnoon_elevation=%e\n", astro->solarnoon_elevation);
-            CACHE_APPEND("solarmidnight_elevation=%e\n", astro->solarmidnight_elevation);
-            g_free(value);
-            g_free(start);
-            g_free(end);
-
-            start = format_date(astro->moonrise, date_format, TRUE);
-            end = format_date(astro->moonset, date_format, TRUE);
-            CACHE_APPEND("moonrise=%s\n", start);
-            CACHE_APPEND("moonset=%s\n", end);
-            CACHE_APPEND("moon_never_rises=%s\n",
-                         astro->moon_never_rises ? "true" : "false");
-            CACHE_APPEND("moon_never_sets=%s\n",
-                         astro->moon_never_sets ? "true" : "false");
-            CACHE_APPEND("moon_phase=%s\n", astro->moon_phase);
-            g_free(start);
-            g_free(end);
-
-            g_string_append(out, "\n");
-        }
+    /* the serialized data is an immutable snapshot that can be
+       written to disk in the background */
+    contents = weather_cache_serialize(&info, data->astrodata,
+                                       data->weatherdata);
+    if (G_LIKELY(contents)) {
+        weather_cache_writer_write(data->cache_writer, file, contents,
+                                   data->download_lock);
+        data->download_lock = -1;
+        g_bytes_unref(contents);
     } else
-        g_string_append(out, "\n");
-
-    for (i = 0; i < wd->timeslices->len; i++) {
-        timeslice = g_array_index(wd->timeslices, xml_time *, i);
-        if (G_UNLIKELY(timeslice == NULL || timeslice->location == NULL))
-            continue;
-        loc = timeslice->location;
-        start = format_date(timeslice->start, date_format, FALSE);
-        end = format_date(timeslice->end, date_format, FALSE);
-        point = format_date(timeslice->point, date_format, FALSE);
-        g_string_append_printf(out, "[timeslice%d]\n", i);
-        CACHE_APPEND("start=%s\n", start);
-        CACHE_APPEND("end=%s\n", end);
-        CACHE_APPEND("point=%s\n", point);
-        CACHE_APPEND("altitude=%s\n", loc->altitude);
-        CACHE_APPEND("latitude=%s\n", loc->latitude);
-        CACHE_APPEND("longitude=%s\n", loc->longitude);
-        CACHE_APPEND("temperature_value=%s\n", loc->temperature_value);
-        CACHE_APPEND("temperature_unit=%s\n", loc->temperature_unit);
-        CACHE_APPEND("wind_dir_deg=%s\n", loc->wind_dir_deg);
-        CACHE_APPEND("wind_dir_name=%s\n", loc->wind_dir_name);
-        CACHE_APPEND("wind_speed_mps=%s\n", loc->wind_speed_mps);
-        CACHE_APPEND("wind_speed_beaufort=%s\n", loc->wind_speed_beaufort);
-        CACHE_APPEND("humidity_value=%s\n", loc->humidity_value);
-        CACHE_APPEND("humidity_unit=%s\n", loc->humidity_unit);
-        CACHE_APPEND("pressure_value=%s\n", loc->pressure_value);
-        CACHE_APPEND("pressure_unit=%s\n", loc->pressure_unit);
-        g_free(start);
-        g_free(end);
-        g_free(point);
-        for (j = 0; j < CLOUDS_PERC_NUM; j++)
-            if (loc->clouds_percent[j])
-                g_string_append_printf(out, "clouds_percent_%d=%s\n", j,
-                                       loc->clouds_percent[j]);
-        CACHE_APPEND("fog_percent=%s\n", loc->fog_percent);
-        CACHE_APPEND("precipitation_value=%s\n", loc->precipitation_value);
-        CACHE_APPEND("precipitation_unit=%s\n", loc->precipitation_unit);
-        if (loc->symbol)
-            g_string_append_printf(out, "symbol_id=%d\nsymbol=%s\n",
-                                   loc->symbol_id, loc->symbol);
-        g_string_append(out, "\n");
-    }
-
-    if (!g_file_set_contents(file, out->str, -1, NULL))
-        g_warning(_("Error writing cache file %s!"), file);
-    else
-        weather_debug("Cache file %s has been written.", file);
-
-    g_string_free(out, TRUE);
+        release_download_lock(data);
     g_free(file);
 }
 
 
+/*
+ * Read a cache file written in the key file format used by older
+ * versions. It will be replaced by a binary one on the next write.
+ */
 static void
-read_cache_file(plugin_data *data)
+read_cache_keyfile(plugin_data *data,
+                   const gchar *file)
 {
     GKeyFile *keyfile;
     GError *err = NULL;
@@ -1214,8 +1689,8 @@ read_cache_file(plugin_data *data)
     xml_location *loc = NULL;
     xml_astro *astro = NULL;
     time_t now_t = time(NULL), cache_date_t;
-    gchar *file, *locname = NULL, *lat = NULL, *lon = NULL, *group = NULL, *offset = NULL;
-    gchar *timestring;
+    gchar *locname = NULL, *lat = NULL, *lon = NULL, *group = NULL, *offset = NULL;
+    gchar *timestring, *value;
     gint msl, num_timeslices = 0, i, j;
 
     g_assert(data != NULL);
@@ -1223,21 +1698,13 @@ read_cache_file(plugin_data *data)
         return;
     wd = data->weatherdata;
 
-    if (G_UNLIKELY(data->lat == NULL || data->lon == NULL))
-        return;
-
-    file = make_cache_filename(data);
-    if (G_UNLIKELY(file == NULL))
-        return;
-
     keyfile = g_key_file_new();
     if (!g_key_file_load_from_file(keyfile, file, G_KEY_FILE_NONE, NULL)) {
         weather_debug("Could not read cache file %s.", file);
-        g_free(file);
+        g_key_file_free(keyfile);
         return;
     }
-    weather_debug("Reading cache file %s.", file);
-    g_free(file);
+    weather_debug("Reading cache file %s in key file format.", file);
 
     group = "info";
     if (!g_key_file_has_group(keyfile, group)) {
@@ -1373,32 +1840,19 @@ read_cache_file(plugin_data *data)
 
         /* parse location data */
         loc = timeslice->location;
-        CACHE_READ_STRING(loc->altitude, "altitude");
-        CACHE_READ_STRING(loc->latitude, "latitude");
-        CACHE_READ_STRING(loc->longitude, "longitude");
-        CACHE_READ_STRING(loc->temperature_value, "temperature_value");
-        CACHE_READ_STRING(loc->temperature_unit, "temperature_unit");
-        CACHE_READ_STRING(loc->wind_dir_name, "wind_dir_name");
-        CACHE_READ_STRING(loc->wind_dir_deg, "wind_dir_deg");
-        CACHE_READ_STRING(loc->wind_speed_mps, "wind_speed_mps");
-        CACHE_READ_STRING(loc->wind_speed_beaufort, "wind_speed_beaufort");
-        CACHE_READ_STRING(loc->humidity_value, "humidity_value");
-        CACHE_READ_STRING(loc->humidity_unit, "humidity_unit");
-        CACHE_READ_STRING(loc->pressure_value, "pressure_value");
-        CACHE_READ_STRING(loc->pressure_unit, "pressure_unit");
-
-        for (j = 0; j < CLOUDS_PERC_NUM; j++) {
-            gchar *key = g_strdup_printf("clouds_percent_%d", j);
-            if (g_key_file_has_key(keyfile, group, key, NULL))
-                loc->clouds_percent[j] =
-                    g_key_file_get_string(keyfile, group, key, NULL);
-            g_free(key);
+        for (j = 0; j < LOC_VALUES_NUM; j++) {
+            CACHE_READ_STRING(value, cache_location_keys[j]);
+            if (value && *value)
+                LOC_SET(loc, j, string_to_double(value, 0));
+            g_free(value);
         }
 
-        CACHE_READ_STRING(loc->fog_percent, "fog_percent");
-        CACHE_READ_STRING(loc->precipitation_value, "precipitation_value");
-        CACHE_READ_STRING(loc->precipitation_unit, "precipitation_unit");
-        CACHE_READ_STRING(loc->symbol, "symbol");
+        CACHE_READ_INTERNED(loc->temperature_unit, "temperature_unit");
+        CACHE_READ_INTERNED(loc->wind_dir_name, "wind_dir_name");
+        CACHE_READ_INTERNED(loc->humidity_unit, "humidity_unit");
+        CACHE_READ_INTERNED(loc->pressure_unit, "pressure_unit");
+        CACHE_READ_INTERNED(loc->precipitation_unit, "precipitation_unit");
+        CACHE_READ_INTERNED(loc->symbol, "symbol");
         if (loc->symbol &&
             g_key_file_has_key(keyfile, group, "symbol_id", NULL))
             loc->symbol_id =
@@ -1412,6 +1866,60 @@ read_cache_file(plugin_data *data)
 }
 
 
+static void
+read_cache_file(plugin_data *data)
+{
+    weather_cache_info info;
+    weather_cache_status status;
+    gchar *file;
+
+    g_assert(data != NULL);
+    if (G_UNLIKELY(data == NULL))
+        return;
+
+    file = make_cache_filename(data);
+    if (G_UNLIKELY(file == NULL))
+        return;
+
+    memset(&info, 0, sizeof(info));
+    info.lat = data->lat;
+    info.lon = data->lon;
+    info.offset = data->offset;
+    info.msl = data->msl;
+    status = weather_cache_read(file, &info, data->cache_file_max_age,
+                                data->astrodata, data->weatherdata);
+    if (status == WEATHER_CACHE_NOT_BINARY)
+        read_cache_keyfile(data, file);
+    else if (status == WEATHER_CACHE_OK) {
+        if (G_LIKELY(data->weather_update)) {
+            data->weather_update->last = info.last_weather_download;
+            data->weather_update->expires = info.weather_expires;
+            data->weather_update->last_modified = info.weather_last_modified;
+            g_free(data->weather_update->url);
+            data->weather_update->url = info.weather_url;
+            info.weather_url = NULL;
+            data->weather_update->next =
+                calc_next_download_time(data->weather_update,
+                                        data->weather_update->last);
+        }
+        if (G_LIKELY(data->astro_update)) {
+            data->astro_update->last = info.last_astro_download;
+            data->astro_update->expires = info.astro_expires;
+            data->astro_update->last_modified = info.astro_last_modified;
+            g_free(data->astro_update->url);
+            data->astro_update->url = info.astro_url;
+            info.astro_url = NULL;
+            data->astro_update->next =
+                calc_next_download_time(data->astro_update,
+                                        data->astro_update->last);
+        }
+    }
+    g_free(info.weather_url);
+    g_free(info.astro_url);
+    g_free(file);
+}
+
+
 void
 update_weatherdata_with_reset(plugin_data *data)
 {
@@ -1439,6 +1947,13 @@ update_weatherdata_with_reset(plugin_data *data)
 
     /* clear update times */
     init_update_infos(data);
+    release_download_lock(data);
+
+    /* drop data of a download that is still in progress */
+    if (data->weather_parser) {
+        xml_weather_parser_free(data->weather_parser);
+        data->weather_parser = NULL;
+    }
 
     /* clear existing weather data */
     if (data->weatherdata) {
@@ -1494,6 +2009,13 @@ close_summary(GtkWidget *widget,
     plugin_data *data = (plugin_data *) user_data;
     GSource *source;
 
+    /* stop loading icons for the window */
+    if (data->summary_cancellable) {
+        g_cancellable_cancel(data->summary_cancellable);
+        g_object_unref(data->summary_cancellable);
+        data->summary_cancellable = NULL;
+    }
+
     if (data->summary_details)
         summary_details_free(data->summary_details);
     data->summary_details = NULL;
@@ -1526,6 +2048,7 @@ forecast_click(GtkWidget *widget,
         /* sync toggle button state */
         gtk_toggle_button_set_active(GTK_TOGGLE_BUTTON(data->button), TRUE);
 
+        data->summary_cancellable = g_cancellable_new();
         data->summary_window = create_summary_window(data);
 
         /* start the summary window subtitle update timer */
@@ -1639,6 +2162,83 @@ upower_changed_cb(UpClient *client,
 #endif /* HAVE_UPOWER_GLIB */
 
 
+/*
+ * Bring a download time calculated before a clock change back into
+ * the usual range. Downloads in progress will set it themselves.
+ */
+static void
+clamp_download_time(update_info *upi,
+                    time_t now_t)
+{
+    time_t next_t;
+
+    if (upi->started && !upi->finished)
+        return;
+
+    next_t = calc_next_download_time(upi, now_t);
+    if (difftime(upi->next, next_t) > 0)
+        upi->next = next_t;
+}
+
+
+static void
+retry_failed_download(update_info *upi,
+                      time_t now_t)
+{
+    if (upi->attempt > 0 && !(upi->started && !upi->finished))
+        upi->next = now_t;
+}
+
+
+/*
+ * The update handler sleeps until the next deadline, so it needs to
+ * be told when that deadline has become wrong.
+ */
+static void
+cb_weather_event(weather_event event,
+                 gpointer user_data)
+{
+    plugin_data *data = user_data;
+    weather_location *loc;
+    time_t now_t = time(NULL);
+    guint i;
+
+    switch (event) {
+    case WEATHER_EVENT_CLOCK_CHANGED:
+        weather_debug("Clock changed, recalculating update times.");
+        clamp_download_time(data->astro_update, now_t);
+        clamp_download_time(data->weather_update, now_t);
+        for (i = 0; data->locations && i < data->locations->len; i++) {
+            loc = g_ptr_array_index(data->locations, i);
+            clamp_download_time(loc->weather_update, now_t);
+        }
+        data->conditions_update->next = now_t;
+        break;
+    case WEATHER_EVENT_RESUMED:
+        /* the timer does not count the time spent suspended */
+        weather_debug("System resumed, updating current conditions.");
+        data->conditions_update->next = now_t;
+        break;
+    case WEATHER_EVENT_NETWORK_AVAILABLE:
+        weather_debug("Network available, retrying failed downloads.");
+        retry_failed_download(data->astro_update, now_t);
+        retry_failed_download(data->weather_update, now_t);
+        for (i = 0; data->locations && i < data->locations->len; i++) {
+            loc = g_ptr_array_index(data->locations, i);
+            retry_failed_download(loc->weather_update, now_t);
+        }
+        break;
+    case WEATHER_EVENT_SCREENSAVER_ACTIVE:
+    case WEATHER_EVENT_SCREENSAVER_INACTIVE:
+        /* nobody can see the scrollbox, downloads go on though */
+        gtk_scrollbox_set_suspended(GTK_SCROLLBOX(data->scrollbox),
+                                    event == WEATHER_EVENT_SCREENSAVER_ACTIVE);
+        return;
+    }
+    schedule_next_wakeup(data);
+}
+
+
 static void
 xfceweather_dialog_response(GtkWidget *dlg,
                             gint response,
@@ -1672,7 +2272,7 @@ xfceweather_dialog_response(GtkWidget *dlg,
 
         weather_debug("Write configuration");
         xfceweather_write_config(data->plugin, data);
-        weather_dump(weather_dump_plugindata, data);
+        weather_dump(dump_plugindata, data);
     }
 }
 
@@ -1712,6 +2312,44 @@ xfceweather_create_options(XfcePanelPlugin *plugin,
 }
 
 
+/* append a short line for every additional location */
+static gchar *
+append_locations_tooltip(const plugin_data *data,
+                         gchar *text)
+{
+    const weather_location *loc;
+    const xml_time *conditions;
+    GString *out;
+    gchar *sym, *temp, *value, *line;
+    const gchar *unit;
+    guint i;
+
+    if (data->locations->len == 0)
+        return text;
+
+    out = g_string_new(text);
+    g_free(text);
+    g_string_append_c(out, '\n');
+    for (i = 0; i < data->locations->len; i++) {
+        loc = g_ptr_array_index(data->locations, i);
+        conditions = loc->weatherdata->current_conditions;
+        if (conditions == NULL)
+            continue;
+
+        sym = get_data(conditions, data->units, SYMBOL,
+                       FALSE, data->night_time);
+        DATA_AND_UNIT(temp, TEMPERATURE);
+        line = g_markup_printf_escaped("\n<b>%s:</b> %s, %s", loc->name, temp,
+                                       translate_desc(sym, data->night_time));
+        g_string_append(out, line);
+        g_free(line);
+        g_free(temp);
+        g_free(sym);
+    }
+    return g_string_free(out, FALSE);
+}
+
+
 static gchar *
 weather_get_tooltip_text(const plugin_data *data)
 {
@@ -1851,7 +2489,50 @@ weather_get_tooltip_text(const plugin_data *data)
     g_free(precipitation);
     g_free(fog);
     g_free(cloudiness);
-    return text;
+    return append_locations_tooltip(data, text);
+}
+
+
+/*
+ * Rebuild the tooltip markup and icon for the current conditions.
+ * The icon is taken from the cache if possible, otherwise it is
+ * loaded in the background and shown when it is ready.
+ */
+static void
+build_tooltip(plugin_data *data)
+{
+    xml_time *conditions;
+    GdkPixbuf *icon;
+    gchar *str;
+    gint size;
+
+    g_free(data->tooltip_markup);
+    data->tooltip_markup = weather_get_tooltip_text(data);
+
+    if (data->tooltip_cancellable) {
+        g_cancellable_cancel(data->tooltip_cancellable);
+        g_object_unref(data->tooltip_cancellable);
+    }
+    data->tooltip_cancellable = g_cancellable_new();
+
+    size = get_tooltip_icon_size(data);
+    conditions = get_current_conditions(data->weatherdata);
+    str = get_data(conditions, data->units, SYMBOL,
+                   data->round, data->night_time);
+    icon = get_icon_cached(data->icon_theme, str, size, data->night_time);
+    if (icon) {
+        if (G_LIKELY(data->tooltip_icon))
+            g_object_unref(G_OBJECT(data->tooltip_icon));
+        data->tooltip_icon = icon;
+    } else
+        get_icon_async(data->icon_theme, str, size, data->night_time,
+                       data->tooltip_cancellable,
+                       cb_tooltip_icon_loaded, data);
+    g_free(str);
+
+    data->tooltip_built = data->tooltip_generation;
+    weather_debug("Built tooltip for generation %u.",
+                  data->tooltip_generation);
 }
 
 
@@ -1863,14 +2544,13 @@ weather_get_tooltip_cb(GtkWidget *widget,
                        GtkTooltip *tooltip,
                        plugin_data *data)
 {
-    gchar *markup_text;
-
     if (data->weatherdata == NULL)
         gtk_tooltip_set_text(tooltip, _("Cannot update weather data"));
     else {
-        markup_text = weather_get_tooltip_text(data);
-        gtk_tooltip_set_markup(tooltip, markup_text);
-        g_free(markup_text);
+        if (data->tooltip_markup == NULL ||
+            data->tooltip_built != data->tooltip_generation)
+            build_tooltip(data);
+        gtk_tooltip_set_markup(tooltip, data->tooltip_markup);
     }
 
     gtk_tooltip_set_icon(tooltip, data->tooltip_icon);
@@ -1899,10 +2579,14 @@ xfceweather_create_control(XfcePanelPlugin *plugin)
     data->units = g_slice_new0(units_config);
     data->weatherdata = make_weather_data();
     data->astrodata = g_array_sized_new(FALSE, TRUE, sizeof(xml_astro *), 30);
+    data->cache_writer = weather_cache_writer_new();
+    data->download_lock = -1;
+    data->events = weather_events_new(cb_weather_event, data);
     data->cache_file_max_age = CACHE_FILE_MAX_AGE;
     data->show_scrollbox = TRUE;
     data->scrollbox_lines = 1;
     data->scrollbox_animate = TRUE;
+    data->scrollbox_duration = DEFAULT_SCROLLBOX_DURATION;
     data->tooltip_style = TOOLTIP_VERBOSE;
     data->forecast_layout = FC_LAYOUT_LIST;
     data->forecast_days = DEFAULT_FORECAST_DAYS;
@@ -1954,6 +2638,8 @@ xfceweather_create_control(XfcePanelPlugin *plugin)
                     "This should not happen, plugin will crash!"));
 
     data->labels = g_array_new(FALSE, TRUE, sizeof(data_types));
+    data->locations =
+        g_ptr_array_new_with_free_func((GDestroyNotify) weather_location_free);
 
     /* create panel toggle button which will contain all other widgets */
     data->button = xfce_panel_create_toggle_button();
@@ -2028,6 +2714,8 @@ xfceweather_free(XfcePanelPlugin *plugin,
         }
     }
 
+    weather_events_free(data->events);
+
 #ifdef HAVE_UPOWER_GLIB
     if (data->upower) {
         g_object_unref(data->upower);
@@ -2035,6 +2723,14 @@ xfceweather_free(XfcePanelPlugin *plugin,
     }
 #endif
 
+    if (data->weather_parser)
+        xml_weather_parser_free(data->weather_parser);
+    g_ptr_array_free(data->locations, TRUE);
+
+    /* make sure the latest data is on disk before leaving */
+    weather_cache_writer_free(data->cache_writer);
+    weather_cache_unlock(data->download_lock);
+
     if (data->weatherdata)
         xml_weather_free(data->weatherdata);
 
@@ -2054,9 +2750,9 @@ xfceweather_free(XfcePanelPlugin *plugin,
     g_free(data->geonames_username);
 
     /* free update infos */
-    g_slice_free(update_info, data->weather_update);
-    g_slice_free(update_info, data->astro_update);
-    g_slice_free(update_info, data->conditions_update);
+    update_info_free(data->weather_update);
+    update_info_free(data->astro_update);
+    update_info_free(data->conditions_update);
 
     /* free current data */
     data->current_astro = NULL;
@@ -2065,7 +2761,18 @@ xfceweather_free(XfcePanelPlugin *plugin,
     g_array_free(data->labels, TRUE);
     astrodata_free(data->astrodata);
 
-    /* free icon theme */
+    /* free icon theme, stopping icons being loaded */
+    if (data->icon_cancellable) {
+        g_cancellable_cancel(data->icon_cancellable);
+        g_object_unref(data->icon_cancellable);
+    }
+    if (data->tooltip_cancellable) {
+        g_cancellable_cancel(data->tooltip_cancellable);
+        g_object_unref(data->tooltip_cancellable);
+    }
+    if (data->tooltip_icon)
+        g_object_unref(G_OBJECT(data->tooltip_icon));
+    g_free(data->tooltip_markup);
     icon_theme_free(data->icon_theme);
 
     g_slice_free(plugin_data, data);
@@ -2100,10 +2807,13 @@ xfceweather_set_size(XfcePanelPlugin *panel,
 #endif
     data->icon_size = icon_size;
 
+    /* icons of the old size are of no use anymore */
+    if (G_LIKELY(data->icon_theme))
+        icon_theme_clear_cache(data->icon_theme);
     update_icon(data);
     update_scrollbox(data, FALSE);
 
-    weather_dump(weather_dump_plugindata, data);
+    weather_dump(dump_plugindata, data);
 
     /* we handled the size */
     return TRUE;
@@ -2144,7 +2854,7 @@ xfceweather_set_mode(XfcePanelPlugin *panel,
 
     xfceweather_set_size(panel, xfce_panel_plugin_get_size(panel), data);
 
-    weather_dump(weather_dump_plugindata, data);
+    weather_dump(dump_plugindata, data);
 
     /* we handled the orientation */
     return TRUE;
@@ -2176,7 +2886,7 @@ xfceweather_set_orientation(XfcePanelPlugin *panel,
     update_icon(data);
     update_scrollbox(data, FALSE);
 
-    weather_dump(weather_dump_plugindata, data);
+    weather_dump(dump_plugindata, data);
 
     /* we handled the orientation */
     return TRUE;
@@ -2294,7 +3004,7 @@ weather_construct(XfcePanelPlugin *plugin)
     }
 #endif /* HAVE_UPOWER_GLIB */
 
-    weather_dump(weather_dump_plugindata, data);
+    weather_dump(dump_plugindata, data);
 }
 
 XFCE_PANEL_PLUGIN_REGISTER(weather_construct)
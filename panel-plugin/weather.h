@@ -27,11 +27,16 @@
 #include <upower.h>
 #endif
 #include "weather-icon.h"
+#include "weather-cache.h"
+#include "weather-events.h"
 
 #define PLUGIN_WEBSITE "https://docs.xfce.org/panel-plugins/xfce4-weather-plugin"
 #define MAX_FORECAST_DAYS 10
 #define DEFAULT_FORECAST_DAYS 5
 #define MAX_SCROLLBOX_LINES 10
+#define DEFAULT_SCROLLBOX_DURATION 500
+#define MAX_SCROLLBOX_DURATION 5000
+#define MAX_SCROLLBOX_FPS 240
 #define FORECAST_API "2.0"
 
 #define SETTING_LOCATION_NAME "/location/name"
@@ -61,7 +66,10 @@
 #define SETTING_SB_FONT       "/scrollbox/font"
 #define SETTING_SB_COLOR      "/scrollbox/color"
 #define SETTING_SB_USE_COLOR  "/scrollbox/use-color"
+#define SETTING_SB_DURATION   "/scrollbox/animation-duration"
+#define SETTING_SB_MAX_FPS    "/scrollbox/max-fps"
 #define SETTING_LABELS        "/labels"
+#define SETTING_LOCATIONS     "/locations"
 
 G_BEGIN_DECLS
 
@@ -91,6 +99,9 @@ typedef struct {
     gboolean started;
     gboolean finished;
     guint http_status_code;
+    time_t expires;             /* server data expiry, 0 if unknown */
+    time_t last_modified;       /* for revalidation, 0 if unknown */
+    gchar *url;                 /* resource last_modified belongs to */
 } update_info;
 
 typedef struct {
@@ -112,7 +123,13 @@ typedef struct {
     GtkWidget *vbox_center_scrollbox;
     GtkWidget *iconimage;
     GdkPixbuf *tooltip_icon;
+    GCancellable *tooltip_cancellable;
+    gchar *tooltip_markup;
+    guint tooltip_generation;
+    guint tooltip_built;
+    GCancellable *icon_cancellable;
     GtkWidget *summary_window;
+    GCancellable *summary_cancellable;
     GtkWidget *summary_subtitle;
     summary_details *summary_details;
     guint config_remember_tab;
@@ -124,8 +141,12 @@ typedef struct {
     XfcePanelPluginMode panel_orientation;
     gboolean single_row;
     xml_weather *weatherdata;
+    xml_weather_parser *weather_parser;
+    weather_cache_writer *cache_writer;
+    gint download_lock;         /* shared with other instances */
     GArray *astrodata;
     xml_astro *current_astro;
+    GPtrArray *locations;       /* additional, see weather-locations.h */
 
     update_info *astro_update;
     update_info *weather_update;
@@ -133,6 +154,8 @@ typedef struct {
     time_t next_wakeup;
     gchar *next_wakeup_reason;
     guint update_timer;
+    guint wakeups;
+    weather_events *events;
     guint summary_update_timer;
 
     GtkWidget *scrollbox;
@@ -142,6 +165,10 @@ typedef struct {
     GdkRGBA scrollbox_color;
     gboolean scrollbox_use_color;
     gboolean scrollbox_animate;
+    guint scrollbox_duration;
+    guint scrollbox_max_fps;
+    guint scrollbox_skipped_frames; /* counters copied for the dump */
+    guint scrollbox_paused_frames;
     GArray *labels;
 
     gchar *location_name;
@@ -171,6 +198,42 @@ void weather_http_queue_request(SoupSession *session,
                                 SoupSessionCallback callback_func,
                                 gpointer user_data);
 
+void weather_http_queue_conditional_request(SoupSession *session,
+                                            const gchar *uri,
+                                            time_t last_modified,
+                                            SoupSessionCallback callback_func,
+                                            gpointer user_data);
+
+SoupMessage *weather_http_queue_request_chunked(SoupSession *session,
+                                                const gchar *uri,
+                                                time_t last_modified,
+                                                GCallback chunk_func,
+                                                SoupSessionCallback callback_func,
+                                                gpointer user_data);
+
+void update_http_validators(update_info *upi,
+                            SoupMessage *msg,
+                            time_t now_t);
+
+time_t get_http_validator(const update_info *upi,
+                          const gchar *url);
+
+xml_weather_parser *make_weather_parser(SoupMessage *msg,
+                                        xml_weather *wd);
+
+gchar *make_forecast_url(const gchar *lat,
+                         const gchar *lon,
+                         gint msl);
+
+update_info *make_update_info(const guint check_interval);
+
+void update_info_free(update_info *upi);
+
+time_t calc_next_download_time(const update_info *upi,
+                               time_t retry_t);
+
+void schedule_next_wakeup(plugin_data *data);
+
 void scrollbox_set_visible(plugin_data *data);
 
 void forecast_click(GtkWidget *widget,
@@ -184,6 +247,8 @@ void update_offset(plugin_data *data);
 
 void update_icon(plugin_data *data);
 
+void invalidate_tooltip(plugin_data *data);
+
 void update_scrollbox(plugin_data *data,
                       gboolean immediately);
 